@@ -0,0 +1,262 @@
+#include "../src/BPlusTree.h"
+#include "../src/DB.h"
+#include <chrono>
+//micro benchmark for the storage path, run from an empty directory: ./bench [rows] [buffer pool mb]
+//prints the syscalls the storage layer makes (io_stats) and the wall time of each phase
+DB db;
+double ms_since(chrono::steady_clock::time_point start){
+    return chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
+}
+void report(const string& phase,size_t ops,double ms){
+    cout<<phase<<": "<<ops<<" ops, "<<ms<<" ms, syscalls total="<<io_stats.total()
+        <<" (open="<<io_stats.opens<<" close="<<io_stats.closes<<" read="<<io_stats.reads<<" write="<<io_stats.writes<<" mmap="<<io_stats.maps<<")"
+        <<", per op="<<(double)io_stats.total()/ops<<endl;
+    cout<<"  buffer pool: hits="<<buffer_pool.stats.hits<<" misses="<<buffer_pool.stats.misses
+        <<" evictions="<<buffer_pool.stats.evictions<<" pages written="<<buffer_pool.stats.write_backs<<endl;
+}
+int main(int argc,char** argv){
+    int rows=argc>1?stoi(argv[1]):10000;
+    if(argc>2) buffer_pool.resize((size_t)stoul(argv[2])<<20); //./bench [rows] [buffer pool mb]
+    filesystem::remove_all("DB_files");
+    filesystem::create_directory("DB_files");
+    db.create_table({"CREATE","T","A:I","B:S","KEY","A"});
+
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    auto start=chrono::steady_clock::now();
+    for(int i=0;i<rows;i++){
+        db.add_record({"INSERT",to_string(i),"\"value"+to_string(i)+"\"","TO","T"});
+    }
+    report("INSERT",rows,ms_since(start));
+
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    start=chrono::steady_clock::now();
+    vector<string> all=db.select_records({"SELECT","*","FROM","T"});
+    report("SELECT * (full scan, mmap)",1,ms_since(start));
+    cout<<"  rows returned="<<all.size()<<endl;
+
+    mmap_reads=false;
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    start=chrono::steady_clock::now();
+    all=db.select_records({"SELECT","*","FROM","T"});
+    report("SELECT * (full scan, buffer pool)",1,ms_since(start));
+    mmap_reads=true;
+
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    start=chrono::steady_clock::now();
+    for(int i=0;i<rows;i+=rows/100+1){
+        db.select_records({"SELECT","*","FROM","T","WHERE","KEY=="+to_string(i)});
+    }
+    report("SELECT point",rows/(rows/100+1)+1,ms_since(start));
+
+    //a scan filtered on int columns: the rows are decoded a batch at a time and compared by column, few rows come out
+    {
+        db.create_table({"CREATE","Q","A:I","B:I","C:I","KEY","A"});
+        for(int i=0;i<rows;i++) db.add_record({"INSERT",to_string(i),to_string(i*7919%1000),to_string(i%10),"TO","Q"});
+        size_t all_threads=scan_threads;
+        for(size_t threads:{(size_t)1,all_threads}){
+            scan_threads=threads;
+            start=chrono::steady_clock::now();
+            size_t found=db.select_records({"SELECT","A","FROM","Q","WHERE","B<10","C>=5"}).size();
+            double ms=ms_since(start);
+            cout<<"SELECT filtered on int columns ("<<threads<<" threads): "<<rows<<" rows scanned, "<<ms<<" ms, "<<ms*1e6/rows<<" ns per row, found="<<found<<endl;
+        }
+    }
+
+    //inserts and point lookups on indexes of the same keys with growing fanout, the height and the misses per lookup fall
+    {
+        vector<string> keys;
+        for(int i=0;i<rows;i++) keys.push_back(db.schemas["T"].key_of({to_string((long long)i*7919%rows)}));
+        for(int fanout:{6,16,64,256}){
+            for(const vector<string>& key_types:{vector<string>{"I"},vector<string>{"I","S"}}){
+                vector<string> index_keys=keys;
+                if(key_types.size()==2) for(string& key:index_keys) append_key_column(key,"tenant/0000","S");
+                unique_ptr<PrimaryIndex> index=make_primary_index(key_types,"bench_fanout",fanout/2);
+                start=chrono::steady_clock::now();
+                for(int i=0;i<rows;i++) index->insert(index_keys[i],streampos(i));
+                double insert_ms=ms_since(start);
+                size_t found=0;
+                start=chrono::steady_clock::now();
+                for(int i=0;i<rows;i++) found+=index->search(index_keys[(long long)i*104729%rows]).has_value();
+                double search_ms=ms_since(start);
+                cout<<"fanout "<<fanout<<(key_types.size()==1?" (int64 keys)":" (string keys)")<<": height="<<index->height()
+                    <<", insert "<<insert_ms*1e6/rows<<" ns, lookup "<<search_ms*1e6/rows<<" ns, found="<<found<<endl;
+            }
+        }
+    }
+
+    //point lookups straight on the index: the int64 tree of T against a tree of the same keys as encoded strings
+    {
+        TreeIndex<string> string_index(DEFAULT_FANOUT/2,"bench_string");
+        for(const auto& [key,offset]:db.schemas["T"].index_tree->getAllValues()) string_index.insert(key,offset);
+        vector<string> keys;
+        for(int i=0;i<rows;i++) keys.push_back(db.schemas["T"].key_of({to_string((long long)i*7919%rows)}));
+        for(PrimaryIndex* index:{db.schemas["T"].index_tree.get(),(PrimaryIndex*)&string_index}){
+            size_t found=0;
+            start=chrono::steady_clock::now();
+            for(const string& key:keys) found+=index->search(key).has_value();
+            double ms=ms_since(start);
+            cout<<"index point lookups ("<<(index==&string_index?"string keys":"int64 keys")<<"): "<<keys.size()<<" lookups, "
+                <<ms*1e6/keys.size()<<" ns each, found="<<found<<endl;
+        }
+    }
+
+    //keys of a tenant and a path, long and sharing most of their bytes: the index keeps the shared part once per node
+    {
+        vector<string> keys;
+        size_t key_bytes=0;
+        for(int i=0;i<rows;i++){
+            long long n=(long long)i*7919%rows;
+            keys.push_back(encode_key({"tenant-"+to_string(n%16),"/projects/warehouse/inventory/item-"+to_string(n)},{"S","S"}));
+            key_bytes+=keys.back().size();
+        }
+        unique_ptr<PrimaryIndex> index=make_primary_index({"S","S"},"bench_paths",DEFAULT_FANOUT/2);
+        start=chrono::steady_clock::now();
+        for(int i=0;i<rows;i++) index->insert(keys[i],streampos(i));
+        double insert_ms=ms_since(start);
+        size_t found=0;
+        start=chrono::steady_clock::now();
+        for(int i=0;i<rows;i++) found+=index->search(keys[(long long)i*104729%rows]).has_value();
+        double search_ms=ms_since(start);
+        cout<<"tenant path keys: "<<key_bytes/rows<<" bytes each, "<<key_bytes/1048576.0<<" MB of keys, index memory "
+            <<index->memory_bytes()/1048576.0<<" MB, insert "<<insert_ms*1e6/rows<<" ns, lookup "<<search_ms*1e6/rows<<" ns, found="<<found<<endl;
+    }
+
+    for(WalSyncPolicy policy:{WalSyncPolicy::EVERY_COMMIT,WalSyncPolicy::EVERY_N_RECORDS,WalSyncPolicy::EVERY_T_MS}){
+        WalConfig config;
+        config.policy=policy;
+        db.wal.configure(config);
+        size_t syncs=db.wal.sync_count();
+        int batch=rows/10;
+        start=chrono::steady_clock::now();
+        for(int i=0;i<batch;i++){
+            db.add_record({"INSERT",to_string(rows+i),"\"value"+to_string(i)+"\"","TO","T"});
+        }
+        double ms=ms_since(start);
+        string name=policy==WalSyncPolicy::EVERY_COMMIT?"every commit":policy==WalSyncPolicy::EVERY_N_RECORDS?"every 64 records":"every 10 ms";
+        cout<<"INSERT with wal sync "<<name<<": "<<batch<<" ops, "<<ms<<" ms, "<<batch/ms*1000<<" ops/s, syncs="<<db.wal.sync_count()-syncs<<endl;
+        for(int i=0;i<batch;i++){
+            db.remove_record({"DELETE",to_string(rows+i),"FROM","T"});
+        }
+    }
+
+    //the same rows as INSERT commands of 100 rows each, with a sync per command
+    {
+        WalConfig config;
+        config.policy=WalSyncPolicy::EVERY_COMMIT;
+        db.wal.configure(config);
+        int batch=rows/10;
+        start=chrono::steady_clock::now();
+        for(int i=0;i<batch;i+=100){
+            vector<string> command={"INSERT"};
+            for(int j=i;j<min(i+100,batch);j++){
+                command.push_back("("+to_string(rows+j));
+                command.push_back("\"value"+to_string(j)+"\")");
+            }
+            command.push_back("TO");
+            command.push_back("T");
+            db.add_record(command);
+        }
+        double ms=ms_since(start);
+        cout<<"INSERT of 100 rows with wal sync every commit: "<<batch<<" rows, "<<ms<<" ms, "<<batch/ms*1000<<" rows/s"<<endl;
+        for(int i=0;i<batch;i++){
+            db.remove_record({"DELETE",to_string(rows+i),"FROM","T"});
+        }
+        db.wal.configure(WalConfig());
+    }
+
+    //crash (no checkpoint since the first insert) and restart, everything in the log is replayed
+    db.wal.sync();
+    db.clear();
+    db.deserialize_DB();
+    cout<<"recovery: "<<db.recovery.replayed<<" records applied, "<<db.recovery.skipped<<" skipped, "<<db.recovery.ms<<" ms, "
+        <<db.recovery.replayed/db.recovery.ms*1000<<" records/s"<<endl;
+
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    start=chrono::steady_clock::now();
+    db.GC();
+    report("GC",1,ms_since(start));
+
+    //restart from the snapshot the GC wrote, nothing left in the log
+    db.clear();
+    start=chrono::steady_clock::now();
+    db.deserialize_DB();
+    cout<<"restore from snapshot: "<<db.schemas["T"].index_tree->getAllKeys().size()<<" keys, "<<ms_since(start)<<" ms, index memory="
+        <<db.schemas["T"].index_tree->memory_bytes()<<" bytes"<<endl;
+
+    //checkpoint after a few changes writes only the changed nodes, compare with a full snapshot
+    for(int i=0;i<rows/100;i++){
+        db.remove_record({"DELETE",to_string(i*97%rows),"FROM","T"});
+    }
+    size_t dirty=db.schemas["T"].index_tree->dirty_count();
+    start=chrono::steady_clock::now();
+    db.checkpoint();
+    cout<<"incremental checkpoint: "<<dirty<<" dirty nodes, "<<db.schemas["T"].index_tree->delta_bytes()<<" bytes, "<<ms_since(start)<<" ms"<<endl;
+    start=chrono::steady_clock::now();
+    db.schemas["T"].index_tree->serialize_Tree();
+    cout<<"full snapshot: "<<db.schemas["T"].index_tree->snapshot_bytes()<<" bytes, "<<ms_since(start)<<" ms"<<endl;
+
+    //INSERT latency while the background compaction copies the table, the lock is only held per chunk
+    {
+        vector<double> latencies;
+        start=chrono::steady_clock::now();
+        db.request_compaction("T");
+        for(int i=0;i<rows/10;i++){
+            auto op_start=chrono::steady_clock::now();
+            db.add_record({"INSERT",to_string(2*rows+i),"\"value"+to_string(i)+"\"","TO","T"});
+            latencies.push_back(ms_since(op_start));
+        }
+        db.wait_for_compactions();
+        double ms=ms_since(start);
+        sort(latencies.begin(),latencies.end());
+        cout<<"INSERT during background compaction: "<<latencies.size()<<" ops, p50="<<latencies[latencies.size()/2]<<" ms, p99="
+            <<latencies[latencies.size()*99/100]<<" ms, max="<<latencies.back()<<" ms, compaction done after "<<ms<<" ms"<<endl;
+    }
+
+    //LOAD of a CSV in reverse key order against the same number of single INSERTs above
+    {
+        ofstream csv("DB_files/bench_load.csv");
+        for(int i=rows-1;i>=0;i--) csv<<i<<",value"<<i<<"\n";
+    }
+    db.create_table({"CREATE","L","A:I","B:S","KEY","A"});
+    io_stats.reset();
+    buffer_pool.stats.reset();
+    start=chrono::steady_clock::now();
+    size_t loaded=db.load_table({"LOAD","L","FROM","DB_files/bench_load.csv"});
+    report("LOAD",loaded,ms_since(start));
+
+    //deletes of recent rows leave garbage in the last segments only, the compaction rewrites just those
+    {
+        data_segment_bytes=1<<20;
+        {
+            ofstream csv("DB_files/bench_segments.csv");
+            char key[16];
+            for(int i=0;i<rows;i++){
+                snprintf(key,sizeof(key),"k%09d",i);
+                csv<<key<<",value"<<i<<"\n";
+            }
+        }
+        db.create_table({"CREATE","S","A:S","B:S","KEY","A"});
+        db.load_table({"LOAD","S","FROM","DB_files/bench_segments.csv"});
+        size_t segments=db.schemas["S"].segments.size();
+        off_t before=db.schemas["S"].record_bytes();
+        char key[16];
+        start=chrono::steady_clock::now();
+        for(int i=rows-rows/10;i<rows;i++){
+            if(i%5==0) continue;
+            snprintf(key,sizeof(key),"\"k%09d\"",i);
+            db.remove_record({"DELETE",key,"FROM","S"});
+        }
+        db.wait_for_compactions();
+        cout<<"DELETE of 8% of the rows (the newest) with compaction of the worst segments: "<<ms_since(start)<<" ms, "<<db.schemas["S"].compactions
+            <<" compactions, "<<segments<<" segments ("<<before<<" bytes) -> "<<db.schemas["S"].segments.size()
+            <<" segments ("<<db.schemas["S"].record_bytes()<<" bytes)"<<endl;
+        data_segment_bytes=(size_t)DATA_SEGMENT_MB<<20;
+    }
+    filesystem::remove_all("DB_files");
+    return 0;
+}
@@ -1,6 +1,9 @@
 #ifndef BPLUS_TREE_H
 #define BPLUS_TREE_H
-#define MIN_DEGREE 3 //MINIMUM DEGREE OF BPLUS TREE
+#define MIN_DEGREE 3 //MINIMUM DEGREE OF BPLUS TREE (the tests use it for deep trees, a table index has the degree of its fanout)
+#define SNAPSHOT_FORMAT_VERSION 2
+#define NODE_LINEAR_SEARCH_KEYS 8 //int64 keys left in a node search when it stops halving and counts
+#define NODE_PREFIX_BYTES 64 //most bytes of the prefix a node of string keys keeps in its block
 #include <algorithm>
 #include <queue>
 #include <iostream>
@@ -12,6 +15,16 @@
 #include <filesystem>
 #include <ostream>
 #include <type_traits>
+#include <functional>
+#include <charconv>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <new>
+#include "FileManager.h"
+#include "NodePool.h"
+#include "Record.h"
+#include "Simd.h"
 using namespace std;
 //in order to use the B_tree using special types you must add them to this conversion functions
 template<typename>
@@ -56,6 +69,19 @@ Type String_to_Type(const std::string& s) {
     }
 }
 
+// same as String_to_Type but parses numbers straight from the view (used on mapped files)
+template<typename Type>
+Type View_to_Type(std::string_view s) {
+    if constexpr (std::is_integral_v<Type> || std::is_same_v<Type, std::streampos>) {
+        long long value = 0;
+        std::from_chars(s.data(), s.data() + s.size(), value);
+        return static_cast<Type>(value);
+    }
+    else {
+        return String_to_Type<Type>(std::string(s));
+    }
+}
+
 // ==================== Refined Type -> String ====================
 
 template<typename Type>
@@ -85,6 +111,213 @@ std::string Type_to_String(const Type& value) {
 }
 
 
+// ==================== Snapshot encoding ====================
+//strings are u32 length + bytes, numbers int64, vectors u32 count + the elements
+
+template<typename Type>
+void put_snapshot_value(std::string& out, const Type& value) {
+    if constexpr (is_vector<Type>::value) {
+        put_u32(out, value.size());
+        for (const auto& elem : value) put_snapshot_value(out, elem);
+    }
+    else if constexpr (std::is_same_v<Type, std::string>) {
+        put_u32(out, value.size());
+        out += value;
+    }
+    else if constexpr (std::is_integral_v<Type> || std::is_same_v<Type, std::streampos>) {
+        put_i64(out, static_cast<long long>(value));
+    }
+    else {
+        static_assert(always_false<Type>, "Unsupported type in put_snapshot_value");
+    }
+}
+
+//reads a value at p and moves p after it, false if it runs past end
+template<typename Type>
+bool get_snapshot_value(const char*& p, const char* end, Type& value) {
+    if constexpr (is_vector<Type>::value) {
+        if (end - p < (ptrdiff_t)sizeof(uint32_t)) return false;
+        uint32_t count = get_u32(p);
+        p += sizeof(uint32_t);
+        value.resize(count);
+        for (auto& elem : value) {
+            if (!get_snapshot_value(p, end, elem)) return false;
+        }
+        return true;
+    }
+    else if constexpr (std::is_same_v<Type, std::string>) {
+        if (end - p < (ptrdiff_t)sizeof(uint32_t)) return false;
+        uint32_t len = get_u32(p);
+        p += sizeof(uint32_t);
+        if (end - p < (ptrdiff_t)len) return false;
+        value.assign(p, len);
+        p += len;
+        return true;
+    }
+    else if constexpr (std::is_integral_v<Type> || std::is_same_v<Type, std::streampos>) {
+        if (end - p < (ptrdiff_t)sizeof(int64_t)) return false;
+        value = static_cast<Type>(get_i64(p));
+        p += sizeof(int64_t);
+        return true;
+    }
+    else {
+        static_assert(always_false<Type>, "Unsupported type in get_snapshot_value");
+    }
+}
+
+// ==================== Node arrays ====================
+//keys, values and children of a node: a fixed capacity array in the node's own allocation (see BPlusTree::allocate_node)
+//with the part of the vector interface the tree uses. the slots after size are raw memory
+template<typename E>
+class NodeArray {
+    E* items = nullptr;
+    uint32_t count = 0;
+    uint32_t cap = 0;
+    void reserve_for(size_t n) {
+        if (n > cap) throw length_error("B+ tree node is full");
+    }
+public:
+    NodeArray() {}
+    NodeArray(const NodeArray&) = delete;
+    NodeArray& operator=(const NodeArray&) = delete;
+    ~NodeArray() { clear(); }
+    void attach(E* memory, size_t capacity) {
+        items = memory;
+        cap = capacity;
+    }
+    E* begin() { return items; }
+    E* end() { return items + count; }
+    const E* begin() const { return items; }
+    const E* end() const { return items + count; }
+    E* data() { return items; }
+    const E* data() const { return items; }
+    size_t size() const { return count; }
+    size_t capacity() const { return cap; }
+    bool empty() const { return count == 0; }
+    E& operator[](size_t i) { return items[i]; }
+    const E& operator[](size_t i) const { return items[i]; }
+    E& front() { return items[0]; }
+    E& back() { return items[count - 1]; }
+    const E& front() const { return items[0]; }
+    const E& back() const { return items[count - 1]; }
+    template<typename V>
+    void push_back(V&& value) {
+        reserve_for(count + 1);
+        new (items + count) E(std::forward<V>(value));
+        count++;
+    }
+    void pop_back() { items[--count].~E(); }
+    void clear() {
+        for (uint32_t i = 0; i < count; i++) items[i].~E();
+        count = 0;
+    }
+    void resize(size_t n) {
+        reserve_for(n);
+        while (count > n) pop_back();
+        for (; count < n; count++) new (items + count) E();
+    }
+    //inserts [first, last) before pos, the elements after it move right
+    template<typename It>
+    E* insert(E* pos, It first, It last) {
+        size_t at = pos - items, n = distance(first, last), old = count;
+        reserve_for(old + n);
+        for (size_t i = old; i > at; i--) {
+            size_t to = i - 1 + n;
+            if (to >= old) new (items + to) E(std::move(items[i - 1]));
+            else items[to] = std::move(items[i - 1]);
+        }
+        for (size_t i = at; first != last; ++first, ++i) {
+            if (i >= old) new (items + i) E(*first);
+            else items[i] = *first;
+        }
+        count = old + n;
+        return items + at;
+    }
+    E* insert(E* pos, const E& value) { return insert(pos, &value, &value + 1); }
+    E* erase(E* pos) {
+        std::move(pos + 1, end(), pos);
+        pop_back();
+        return pos;
+    }
+    template<typename It>
+    void assign(It first, It last) {
+        clear();
+        reserve_for(distance(first, last));
+        for (; first != last; ++first) push_back(*first);
+    }
+};
+
+//the prefix of a node of string keys, its bytes are in the block of the node (NODE_PREFIX_BYTES of them).
+//any prefix the keys share is valid, so a longer shared prefix is only kept shorter
+class NodePrefix {
+    char* bytes = nullptr;
+    uint32_t length = 0;
+public:
+    NodePrefix() {}
+    NodePrefix(const NodePrefix&) = delete;
+    //copies the bytes into the block of this node
+    NodePrefix& operator=(const NodePrefix& other) {
+        memcpy(bytes, other.bytes, other.length);
+        length = other.length;
+        return *this;
+    }
+    void attach(char* memory) { bytes = memory; }
+    size_t size() const { return length; }
+    size_t room() const { return NODE_PREFIX_BYTES - length; }
+    string_view view() const { return string_view(bytes, length); }
+    operator string_view() const { return view(); }
+    void resize(size_t n) { length = n; } // only shorter
+    void append(string_view more) {
+        memcpy(bytes + length, more.data(), more.size());
+        length += more.size();
+    }
+};
+struct NoPrefix {}; //the nodes of other keys have none
+
+// ==================== In-node search ====================
+//index of the first key in a node that is not less than key (upper: greater than key).
+//int64 keys are searched without branches: the range is halved with a conditional move until a few keys are left,
+//those are counted with one compare each (4 at a time when simd_level has AVX2), so a lookup never mispredicts inside a node
+#ifdef SIMD_X86
+template<bool upper>
+TARGET_AVX2 size_t count_before_avx2(const int64_t* base, size_t n, int64_t key, size_t& i) {
+    size_t count = 0;
+    __m256i needle = _mm256_set1_epi64x(key);
+    for (; i + 4 <= n; i += 4) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(base + i));
+        __m256i before = upper ? _mm256_xor_si256(_mm256_cmpgt_epi64(block, needle), _mm256_set1_epi64x(-1))
+                               : _mm256_cmpgt_epi64(needle, block);
+        count += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(before)));
+    }
+    return count;
+}
+#endif
+template<bool upper, typename T, typename Keys>
+size_t node_bound(const Keys& keys, const T& key) {
+    if constexpr (std::is_same_v<T, int64_t>) {
+        const int64_t* base = keys.data();
+        size_t n = keys.size();
+        while (n > NODE_LINEAR_SEARCH_KEYS) {
+            size_t half = n / 2;
+            bool right = upper ? base[half - 1] <= key : base[half - 1] < key;
+            base += right * half;
+            n -= half;
+        }
+        size_t count = 0, i = 0;
+#ifdef SIMD_X86
+        if (simd_level == SimdLevel::AVX2) count = count_before_avx2<upper>(base, n, key, i);
+#endif
+        for (; i < n; i++) count += upper ? base[i] <= key : base[i] < key;
+        return (base - keys.data()) + count;
+    }
+    else if constexpr (upper) {
+        return distance(keys.begin(), upper_bound(keys.begin(), keys.end(), key));
+    }
+    else {
+        return distance(keys.begin(), lower_bound(keys.begin(), keys.end(), key));
+    }
+}
+
 // B plus tree class
 //T is index type and S value type
 template <typename T,typename S> class BPlusTree {
@@ -92,16 +325,163 @@ public: //maybe change to private later
     // structure to create a node
     struct Node {
         bool isLeaf;
-        streampos offset;     // Offset in file (if needed) only for leaf nodes
-        vector<T> keys;
-        vector<Node*> children;
+        [[no_unique_address]] conditional_t<is_same_v<T, string>, NodePrefix, NoPrefix> prefix; // string keys: the bytes every key of the node starts with, keys holds the rest
+        NodeArray<T> keys;
+        NodeArray<S> values;     // only for leaf nodes, values[i] belongs to keys[i]
+        NodeArray<Node*> children; // only for internal nodes
         Node* next; 
-        Node(bool leaf = false) : isLeaf(leaf),offset(streampos(-1)) ,next(nullptr) {}
+        uint64_t id; // names the node in the snapshot and delta files
+        Node(bool leaf = false) : isLeaf(leaf) ,next(nullptr), id(0) {}
+    };
+    struct LoadedNode {
+        Node* node = nullptr;
+        size_t first_child = 0; // children ids are in child_ids[first_child, first_child+child_count), linked once every node is loaded
+        size_t child_count = 0;
     };
 
     Node* root;
     int t; // Minimum degree
+    NodePool leaf_pool; // the nodes of this tree, sized for t
+    NodePool internal_pool;
     string file_name;
+    // Checkpoint state
+    uint64_t next_id = 1;
+    unordered_set<Node*> dirty_nodes; // changed since the last checkpoint
+    uint64_t generation = 0; // of the current snapshot, 0 if there is none yet
+    size_t delta_bytes = 0;
+    size_t snapshot_bytes = 0;
+    uint64_t checkpoint_root = 0; // root id at the last checkpoint
+    //a node is one block of its pool: the node, the prefix bytes (string keys), its keys and then its values (leaf) or
+    //children, the arrays on cache lines. 2t-1 keys and 2t children is the most a node holds in between the steps of
+    //insert, remove and bulk_load
+    size_t key_capacity() const { return 2 * t - 1; }
+    static size_t line_up(size_t bytes) { return (bytes + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE; }
+    static constexpr size_t prefix_bytes() { return is_same_v<T, string> ? NODE_PREFIX_BYTES : 0; }
+    size_t node_bytes(bool leaf) const {
+        return line_up(sizeof(Node)) + line_up(prefix_bytes()) + line_up(key_capacity() * sizeof(T))
+            + (leaf ? key_capacity() * sizeof(S) : (key_capacity() + 1) * sizeof(Node*));
+    }
+    Node* allocate_node(bool leaf) {
+        char* block = (char*)(leaf ? leaf_pool : internal_pool).allocate();
+        Node* node = new (block) Node(leaf);
+        if constexpr (truncated) node->prefix.attach(block + line_up(sizeof(Node)));
+        char* keys = block + line_up(sizeof(Node)) + line_up(prefix_bytes());
+        node->keys.attach((T*)keys, key_capacity());
+        char* rest = keys + line_up(key_capacity() * sizeof(T));
+        if (leaf) node->values.attach((S*)rest, key_capacity());
+        else node->children.attach((Node**)rest, key_capacity() + 1);
+        return node;
+    }
+    void release_node(Node* node) {
+        NodePool& pool = node->isLeaf ? leaf_pool : internal_pool;
+        node->~Node();
+        pool.deallocate(node);
+    }
+    template<typename F>
+    void visit_nodes(F visit) {
+        vector<Node*> stack;
+        if (root) stack.push_back(root);
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            if (!node->isLeaf) stack.insert(stack.end(), node->children.begin(), node->children.end());
+            visit(node);
+        }
+    }
+    Node* make_node(bool leaf) {
+        Node* node = allocate_node(leaf);
+        node->id = next_id++;
+        dirty_nodes.insert(node);
+        return node;
+    }
+    void touch(Node* node) { dirty_nodes.insert(node); }
+    //string keys are kept prefix truncated: a node keeps what all of its keys start with once in prefix and only
+    //the rest of each key in keys (any prefix they share is valid, an empty one too). the helpers below take and give full keys
+    static constexpr bool truncated = is_same_v<T, string>;
+    static size_t common_prefix(string_view a, string_view b) {
+        size_t n = 0;
+        while (n < a.size() && n < b.size() && a[n] == b[n]) n++;
+        return n;
+    }
+    //the shortest key that is bigger than left and not bigger than right (right for other types), the separator
+    //copied up when leaves are split: a descent only needs left < separator <= right and any longer bytes are wasted
+    static T separator(const T& left, const T& right) {
+        if constexpr (truncated) return right.substr(0, common_prefix(left, right) + 1);
+        else return right;
+    }
+    T key_at(const Node* node, size_t i) const {
+        if constexpr (truncated) return string(node->prefix.view()).append(node->keys[i]);
+        else return node->keys[i];
+    }
+    //<0, 0 or >0 as key i of node is smaller, equal or bigger than key
+    int compare_at(const Node* node, size_t i, const T& key) const {
+        if constexpr (truncated) {
+            size_t p = node->prefix.size();
+            if (int c = node->prefix.view().compare(string_view(key).substr(0, p))) return c;
+            return string_view(node->keys[i]).compare(string_view(key).substr(min(p, key.size())));
+        }
+        else return node->keys[i] < key ? -1 : key < node->keys[i] ? 1 : 0;
+    }
+    bool key_is(const Node* node, size_t i, const T& key) const { return i < node->keys.size() && compare_at(node, i, key) == 0; }
+    //node_bound on the full keys of node: a key outside the prefix is before or after all of them
+    template<bool upper>
+    size_t bound(const Node* node, const T& key) const {
+        if constexpr (truncated) {
+            size_t p = node->prefix.size();
+            if (int c = string_view(key).substr(0, p).compare(node->prefix.view())) return c < 0 ? 0 : node->keys.size();
+            string_view rest = string_view(key).substr(p);
+            if constexpr (upper) return upper_bound(node->keys.begin(), node->keys.end(), rest, [](string_view a, const string& b) { return a < b; }) - node->keys.begin();
+            else return lower_bound(node->keys.begin(), node->keys.end(), rest, [](const string& a, string_view b) { return a < b; }) - node->keys.begin();
+        }
+        else return node_bound<upper>(node->keys, key);
+    }
+    //gives bytes of the prefix back to the keys until the prefix is n bytes long
+    void shorten_prefix(Node* node, size_t n) {
+        if (n == node->prefix.size()) return;
+        string_view dropped = node->prefix.view().substr(n);
+        for (string& key : node->keys) key.insert(0, dropped);
+        node->prefix.resize(n);
+    }
+    //moves what the keys of node still share into its prefix (they are sorted, the first and the last share the least)
+    void extend_prefix(Node* node) {
+        if constexpr (truncated) {
+            if (node->keys.size() < 2) return;
+            size_t n = min(common_prefix(node->keys.front(), node->keys.back()), node->prefix.room());
+            if (n == 0) return;
+            node->prefix.append(string_view(node->keys.front()).substr(0, n));
+            for (string& key : node->keys) key.erase(0, n);
+        }
+    }
+    void insert_key(Node* node, size_t i, const T& key) {
+        if constexpr (truncated) {
+            shorten_prefix(node, common_prefix(node->prefix, key));
+            node->keys.insert(node->keys.begin() + i, key.substr(node->prefix.size()));
+        }
+        else node->keys.insert(node->keys.begin() + i, key);
+    }
+    void set_key(Node* node, size_t i, const T& key) {
+        if constexpr (truncated) {
+            shorten_prefix(node, common_prefix(node->prefix, key));
+            node->keys[i] = key.substr(node->prefix.size());
+        }
+        else node->keys[i] = key;
+    }
+    void free_node(Node* node) {
+        dirty_nodes.erase(node);
+        release_node(node);
+    }
+    void free_subtree(Node* node) {
+        if (!node) return;
+        for (Node* child : node->children) free_subtree(child);
+        free_node(node);
+    }
+    string manifest_path() const { return "DB_files/"+file_name+".manifest"; }
+    string snapshot_path(uint64_t gen) const { return "DB_files/"+file_name+"."+to_string(gen)+".snap"; }
+    string delta_path(uint64_t gen) const { return "DB_files/"+file_name+"."+to_string(gen)+".delta"; }
+    string encode_nodes(const vector<Node*>& nodes);
+    bool decode_nodes(const char* p, const char* end, vector<LoadedNode>& loaded, vector<uint64_t>& child_ids);
+    bool link_nodes(vector<LoadedNode>& loaded, const vector<uint64_t>& child_ids, uint64_t root_id);
+    bool write_manifest();
     // Helper functions for insertion
     void splitChild(Node* parent, int index, Node* child);
     void insertNonFull(Node* node, const T& key, const S& value);
@@ -115,101 +495,166 @@ public: //maybe change to private later
     // Helper for printing
     void printTree(Node* node, int level);
 public:
-    BPlusTree(int degree=MIN_DEGREE,const string& file_name=""): root(nullptr), t(degree), file_name(file_name+"_BPlusTree") {
+    BPlusTree(int degree=MIN_DEGREE,const string& file_name=""): root(nullptr), t(degree), leaf_pool(node_bytes(true)),
+        internal_pool(node_bytes(false)), file_name(file_name+"_BPlusTree") {
     }
+    //forward cursor over the leaf chain: seek places it at a key, next moves to the following pair in key order.
+    //a key is only built when it is read, so walking a range copies nothing. it is valid until the tree changes
+    class Cursor {
+        const BPlusTree* tree = nullptr;
+        Node* leaf = nullptr;
+        size_t i = 0;
+        void skip_empty() {
+            while (leaf && i >= leaf->keys.size()) {
+                leaf = leaf->next;
+                i = 0;
+            }
+        }
+    public:
+        Cursor() {}
+        Cursor(const BPlusTree* tree, Node* leaf, size_t i) : tree(tree), leaf(leaf), i(i) { skip_empty(); }
+        bool valid() const { return leaf != nullptr; }
+        void next() {
+            i++;
+            skip_empty();
+        }
+        T key() const { return tree->key_at(leaf, i); }
+        const S& value() const { return leaf->values[i]; }
+        //<0, 0 or >0 as the current key is smaller, equal or bigger than key (without building the key)
+        int compare(const T& key) const { return tree->compare_at(leaf, i, key); }
+    };
+    Cursor first() const;
+    Cursor seek(const T& key) const; // at the first key not less than key
+    vector<T> leaf_splits(const optional<T>& lower, const optional<T>& upper, size_t step) const;
     void insert(const T& key, const S& value);
     optional<S> search(const T& key);
+    bool update(const T& key, const S& value);
+    int find_first_existing(const vector<T>& keys);
     void remove(const T& key);
     T findSmallestInSubtree(Node *node);
     vector<T> rangeQueryKeys(const T &lower, const T &upper);
     vector<pair<T, S>> rangeQuery(const T &lower, const T &upper);
     vector<T> getAllKeys();
     vector<pair<T, S>> getAllValues();
+    vector<pair<T, S>> valuesAfter(const optional<T>& after, size_t limit);
     void printTree();
     T get_Max();
     T get_Min();
-    ~BPlusTree() {
-        // Destructor to free memory
-        // Implement a recursive function to delete all nodes
-        function<void(Node*)> deleteNode = [&](Node* node) {
-            if (node) {
-                for (Node* child : node->children) {
-                    deleteNode(child);
-                }
-                delete node;
-            }
-        };
-        deleteNode(root);
+    ~BPlusTree() { clear(); }
+    //drops every node at once: the slabs go back to the heap, the nodes are only walked when keys or values own memory
+    void clear() {
+        if constexpr (!is_trivially_destructible_v<T> || !is_trivially_destructible_v<S>) {
+            visit_nodes([](Node* node) { node->~Node(); });
+        }
+        leaf_pool.release();
+        internal_pool.release();
+        root = nullptr;
+        dirty_nodes.clear();
+    }
+    //bytes the index takes: the slabs of its pools and the string keys too long to be kept in the node
+    size_t memory_bytes() {
+        size_t bytes = leaf_pool.reserved_bytes() + internal_pool.reserved_bytes();
+        if constexpr (truncated) {
+            auto heap_bytes = [](const string& key) {
+                return key.data() < (const char*)&key || key.data() >= (const char*)(&key + 1) ? key.capacity() + 1 : 0;
+            };
+            visit_nodes([&](Node* node) {
+                for (const string& key : node->keys) bytes += heap_bytes(key);
+            });
+        }
+        return bytes;
     }
+    size_t node_count() const { return leaf_pool.blocks() + internal_pool.blocks(); }
     void GC_with_values(vector<S> values);
-    void serialize_Tree();
+    void bulk_load(const function<bool(T&, S&)>& next);
+    void rebuild();
+    bool serialize_Tree();
+    bool checkpoint();
     void deserialize_Tree();
+    bool load_checkpoint();
+    bool load_snapshot_v1(const string& path);
+    void deserialize_text_Tree();
+    bool has_files();
+    bool has_binary_files() { return filesystem::exists(manifest_path()) || filesystem::exists("DB_files/" + file_name + ".snap"); }
+    void remove_files();
+    size_t dirty_count() const { return dirty_nodes.size(); }
+    size_t height() const {
+        size_t levels = 0;
+        for (Node* node = root; node; node = node->isLeaf ? nullptr : node->children.front()) levels++;
+        return levels;
+    }
 };
 
 // Maybe dont need and can be saved in bTree
 vector<string> read_line_from_file(const string& file,streampos offset) {
-   vector<string> result;
-    ifstream infile("DB_files/"+file+".txt", ios::binary);
-    if (!infile || offset == streampos(-1)) {
+    vector<string> result;
+    if (offset == streampos(-1)) return result;
+    StorageFile& infile = file_manager.get(file);
+    if (!infile.is_open()) {
         // cerr << "Error opening file or invalid offset: " << file << endl;
         return result;
     }
-    infile.seekg(offset);
+    string_view view;
     string line;
-    if (getline(infile, line)) {
+    if (infile.view_line(offset, view)) {
+        line.assign(view);
+    }
+    else if (!infile.read_line(offset, line)) {
+        return result;
+    }
+    {
         stringstream ss(line);
         string token;
         while (ss >> token) {
             result.emplace_back(token);
         }
     }
-    infile.close();
     return result;
 }
-streampos write_line_to_file(const string& file,const vector<string>& data) {
-    ofstream outfile("DB_files/"+file+".txt", ios::binary | ios::app);
-    if (!outfile) {
-        cerr << "Error opening file for writing: " << file << endl;
-        return streampos(-1);
-    }
-    // Get the position before writing, this will be the offset for this new data block.
-    std::ifstream in("DB_files/"+file+".txt", std::ios::binary | std::ios::ate);
-    streampos position = in.tellg();
-    int size_minus_one = data.size() - 1;
-    if(size_minus_one>=0)
-    {
-        for (int i = 0; i < size_minus_one; i++) {
-            outfile << data[i] << " ";
+// reads the line at offset as values of type S, parsed in place from the mapping when possible
+template <typename S>
+vector<S> read_values_from_file(const string& file,streampos offset) {
+    vector<S> result;
+    if (offset == streampos(-1)) return result;
+    StorageFile& infile = file_manager.get(file);
+    string_view line;
+    if (!infile.view_line(offset, line)) {
+        for (const string& token : read_line_from_file(file, offset)) {
+            result.push_back(String_to_Type<S>(token));
         }
-        outfile << data[size_minus_one] << "\n";
+        return result;
     }
-    outfile.close();
-    return position;
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t end = line.find(' ', start);
+        if (end == string_view::npos) end = line.size();
+        if (end > start) result.push_back(View_to_Type<S>(line.substr(start, end - start)));
+        start = end + 1;
+    }
+    return result;
 }
 //Insertion helper functions
 template <typename T, typename S>
 void BPlusTree<T, S>::splitChild(Node* parent, int index, Node* child) {
-    Node* new_child = new Node(child->isLeaf);
-    T middle_key = child->keys[t - 1];
+    Node* new_child = make_node(child->isLeaf);
+    touch(parent);
+    touch(child);
+    T middle_key;
+    new_child->prefix = child->prefix;
     if (child->isLeaf) {
 
-        // Move the second half of the keys to the new node
+        // Move the second half of the keys and their values to the new node
         new_child->keys.assign(child->keys.begin() + t -1, child->keys.end());
         child->keys.resize(t - 1);
-
-        // Handle the data in the file
-        vector<string> data = read_line_from_file(file_name, child->offset);
-        vector<string> new_child_data(data.begin() + t - 1, data.end());
-        data.resize(t - 1);
-
-        // Write the split data back to the file in new locations
-        child->offset = write_line_to_file(file_name, data);
-        new_child->offset = write_line_to_file(file_name, new_child_data);
+        middle_key = separator(key_at(child, t - 2), key_at(new_child, 0));
+        new_child->values.assign(child->values.begin() + t -1, child->values.end());
+        child->values.resize(t - 1);
 
         // Link the leaves
         new_child->next = child->next;
         child->next = new_child;
     } else { // Internal node split
+        middle_key = key_at(child, t - 1);
         // Move keys and children to the new node
         new_child->keys.assign(child->keys.begin() + t, child->keys.end());
         child->keys.resize(t-1); // Remove middle key and second half
@@ -218,8 +663,11 @@ void BPlusTree<T, S>::splitChild(Node* parent, int index, Node* child) {
         new_child->children.assign(child->children.begin() + t, child->children.end());
         child->children.resize(t);
     }
+    // each half may share more than the whole did
+    extend_prefix(child);
+    extend_prefix(new_child);
     // Insert the middle key into the parent node and link the new child
-    parent->keys.insert(parent->keys.begin() + index, middle_key);
+    insert_key(parent, index, middle_key);
     parent->children.insert(parent->children.begin() + index + 1, new_child);
 }
 // Implementation of insertNonFull function
@@ -228,19 +676,12 @@ void BPlusTree<T,S>::insertNonFull(Node* node, const T& key, const S& value)
 {
      if (node->isLeaf) {
         // Find position to insert the key into vector of keys
-        auto it = upper_bound(node->keys.begin(), node->keys.end(), key);
-        int insert_pos = distance(node->keys.begin(), it);
-        node->keys.insert(it, key);
-        //insert value to the file
-        vector<string> data = read_line_from_file(file_name, node->offset);
-        data.insert(data.begin() + insert_pos, Type_to_String(value) );
-        node->offset = write_line_to_file(file_name, data);
+        int insert_pos = bound<true>(node, key);
+        insert_key(node, insert_pos, key);
+        node->values.insert(node->values.begin() + insert_pos, value);
+        touch(node);
     } else {
-        //maybe can be optimized with binary search
-        int i;
-        auto it = upper_bound(node->keys.begin(),node->keys.end(),key);
-        if(it==node->keys.end()){ i=node->keys.size();} //here is key bigger then everything
-        else {i=distance(node->keys.begin(),it);}
+        int i = bound<true>(node, key);
         //the original code
         // int i = node->keys.size() - 1;
         // while (i >= 0 && key < node->keys[i]) {
@@ -250,7 +691,8 @@ void BPlusTree<T,S>::insertNonFull(Node* node, const T& key, const S& value)
         // If the found child is full, then split it
         if (node->children[i]->keys.size() == 2 * t - 1) {
             splitChild(node, i, node->children[i]);
-            if (key > node->keys[i]) {
+            // a key equal to the separator goes right too (a truncated separator need not be a key of the tree)
+            if (compare_at(node, i, key) <= 0) {
                 i++;
             }
         }
@@ -261,14 +703,12 @@ template <typename T,typename S>
 void BPlusTree<T,S>::insert(const T& key, const S& value)
 {
     if (root == nullptr) {
-        root = new Node(true); // Create a new leaf root
-        root->keys.push_back(key);
-        // Write the first data block to the file
-        vector<string> data = {Type_to_String(value)};
-        root->offset = write_line_to_file(file_name, data);
+        root = make_node(true); // Create a new leaf root
+        insert_key(root, 0, key);
+        root->values.push_back(value);
     } else {
         if (root->keys.size() == 2 * t - 1) {
-            Node* newRoot = new Node(false); // New root is an internal node
+            Node* newRoot = make_node(false); // New root is an internal node
             newRoot->children.push_back(root);
             splitChild(newRoot, 0, root);
             root = newRoot;
@@ -283,144 +723,122 @@ optional<S> BPlusTree<T, S>::search(const T& key) {
     if (current == nullptr) return nullopt;
 
     while (!current->isLeaf) {
-        // Find the first key that is >= our search key
-        auto it = lower_bound(current->keys.begin(), current->keys.end(), key);
-        int i = distance(current->keys.begin(), it);
-        
-        // If the key is found in an internal node, we must go to the right child
-        if (i < current->keys.size() && current->keys[i] == key) {
-             current = current->children[i+1];
-        } else {
-             current = current->children[i];
-        }
+        // Equal separator means the key is in the right child, the first key > key gives the child
+        current = current->children[bound<true>(current, key)];
     }
 
     // Now at a leaf node, search for the key
-    auto it = lower_bound(current->keys.begin(), current->keys.end(), key);
-    if (it != current->keys.end() && *it == key) {
-        int key_pos = distance(current->keys.begin(), it);
-        vector<string> data = read_line_from_file(file_name, current->offset);
-        if (key_pos < data.size()) {
-            return String_to_Type<S>(data[key_pos]);
-        }
+    size_t i = bound<false>(current, key);
+    if (key_is(current, i, key)) {
+        return current->values[i];
     }
 
     return nullopt;
 }
 
-// can be optimized to only check first and last key of each leaf node and if both in range, read whole leaf and line
+// replaces the value of an existing key, false if the key is not in the tree
 template <typename T, typename S>
-vector<T> BPlusTree<T, S>::rangeQueryKeys(const T& lower, const T& upper) {
-    vector<T> result;
-    if (root == nullptr) return result;
-
+bool BPlusTree<T, S>::update(const T& key, const S& value) {
     Node* current = root;
-    // Traverse to the first leaf node that might contain the lower bound
-    while (!current->isLeaf) {
-        auto it = upper_bound(current->keys.begin(), current->keys.end(), lower);
-        int i = distance(current->keys.begin(), it);
-        current = current->children[i];
-    }
-    // Scan through leaf nodes
-    while (current != nullptr) {
-        if(current->keys.empty() || current->keys.front() > upper) {
-            break; // No more keys in range
-        }
-        if(current->keys.back() <= upper &&current->keys.front()>=lower) {
-            for (int i = 0; i < current->keys.size(); i++) {
-                result.push_back(current->keys[i]);
-            }
+    if (current == nullptr) return false;
+    while (!current->isLeaf) current = current->children[bound<true>(current, key)];
+    size_t i = bound<false>(current, key);
+    if (!key_is(current, i, key)) return false;
+    current->values[i] = value;
+    touch(current);
+    return true;
+}
+
+// keys must be in increasing order, returns the index of the first one that is in the tree or -1.
+// the leaf of the next key is usually the same one or the one after it so the tree is only descended again after a gap
+template <typename T, typename S>
+int BPlusTree<T, S>::find_first_existing(const vector<T>& keys) {
+    if (root == nullptr) return -1;
+    Node* leaf = nullptr;
+    for (size_t k = 0; k < keys.size(); k++) {
+        const T& key = keys[k];
+        if (leaf && !leaf->keys.empty() && compare_at(leaf, leaf->keys.size() - 1, key) < 0) {
+            Node* next = leaf->next;
+            leaf = next && !next->keys.empty() && compare_at(next, next->keys.size() - 1, key) >= 0 ? next : nullptr;
         }
-        else{
-                auto it = upper_bound(current->keys.begin(), current->keys.end(), lower);
-                auto dist = distance(current->keys.begin(), it);
-                auto a=dist-1;
-                if(dist>0&&current->keys[a]==lower){
-                    result.push_back(current->keys[a]);
-                }
-                for (int i = dist;  i < current->keys.size(); i++) {
-                    if(current->keys[i] > upper) break;
-                    result.push_back(current->keys[i]);
-                }
+        if (leaf == nullptr || leaf->keys.empty()) {
+            leaf = root;
+            while (!leaf->isLeaf) leaf = leaf->children[bound<true>(leaf, key)];
         }
-        current = current->next;
+        if (key_is(leaf, bound<false>(leaf, key), key)) return k;
     }
-    return result;
+    return -1;
 }
 
+template <typename T, typename S>
+typename BPlusTree<T, S>::Cursor BPlusTree<T, S>::first() const {
+    Node* current = root;
+    while (current && !current->isLeaf) current = current->children.front();
+    return Cursor(this, current, 0);
+}
 
 template <typename T, typename S>
-vector<pair<T, S>> BPlusTree<T, S>::rangeQuery(const T& lower, const T& upper) {
-    vector<pair<T, S>> result;
-    if (root == nullptr) return result;
+typename BPlusTree<T, S>::Cursor BPlusTree<T, S>::seek(const T& key) const {
+    Node* current = root;
+    if (current == nullptr) return Cursor();
+    while (!current->isLeaf) current = current->children[bound<true>(current, key)];
+    return Cursor(this, current, bound<false>(current, key));
+}
 
+// first keys of every step-th leaf after the leaf of lower, up to upper. they cut a scan from lower to upper into parts
+// of step leaves, only the leaf pointers are followed
+template <typename T, typename S>
+vector<T> BPlusTree<T, S>::leaf_splits(const optional<T>& lower, const optional<T>& upper, size_t step) const {
+    vector<T> result;
     Node* current = root;
-    // Traverse to the first leaf node that might contain the lower bound
-    while (!current->isLeaf) {
-        auto it = upper_bound(current->keys.begin(), current->keys.end(), lower);
-        int i = distance(current->keys.begin(), it);
-        current = current->children[i];
+    if (current == nullptr || step == 0) return result;
+    while (!current->isLeaf) current = lower ? current->children[bound<true>(current, *lower)] : current->children.front();
+    for (size_t walked = 0; (current = current->next) != nullptr;) {
+        if (++walked % step != 0 || current->keys.empty()) continue;
+        if (upper && compare_at(current, 0, *upper) > 0) break;
+        result.push_back(key_at(current, 0));
     }
-    // Scan through leaf nodes
-    while (current != nullptr) {
-        if(current->keys.empty() || current->keys.front() > upper) {
-            break; // No more keys in range
-        }
-        vector<string> data = read_line_from_file(file_name, current->offset);
-        if(current->keys.back() <= upper &&current->keys.front()>=lower) {
-            for (int i = 0; i < data.size(); i++) {
-                result.push_back(make_pair(current->keys[i], String_to_Type<S>((data[i]))));
-            }
-        }
-        else{
-                auto it = upper_bound(current->keys.begin(), current->keys.end(), lower);
-                auto dist = distance(current->keys.begin(), it);
-                auto a=dist-1;
-                if(dist>0&&current->keys[a]==lower){
-                    result.push_back(make_pair(current->keys[a], String_to_Type<S>((data[a]))));
-                }
-                for (int i = dist;  i < data.size(); i++) {
-                    if(current->keys[i] > upper) break;
-                    result.push_back(make_pair(current->keys[i], String_to_Type<S>((data[i]))));
-                }
-        }
-        current = current->next;
+    return result;
+}
+
+// one descent to the first key, then the leaves are walked until a key is above upper
+template <typename T, typename S>
+vector<T> BPlusTree<T, S>::rangeQueryKeys(const T& lower, const T& upper) {
+    vector<T> result;
+    for (Cursor cursor = seek(lower); cursor.valid() && cursor.compare(upper) <= 0; cursor.next()) result.push_back(cursor.key());
+    return result;
+}
+
+template <typename T, typename S>
+vector<pair<T, S>> BPlusTree<T, S>::rangeQuery(const T& lower, const T& upper) {
+    vector<pair<T, S>> result;
+    for (Cursor cursor = seek(lower); cursor.valid() && cursor.compare(upper) <= 0; cursor.next()) {
+        result.push_back(make_pair(cursor.key(), cursor.value()));
     }
     return result;
 }
+
 template <typename T, typename S>
 vector<pair<T, S>> BPlusTree<T, S>::getAllValues(){
     vector<pair<T, S>> result;
-    if (root == nullptr) return result;
-    Node* current = root;
-    while (!current->isLeaf) {
-        current = current->children[0];
-    }
-    while (current != nullptr) {
-        vector<string> data = read_line_from_file(file_name, current->offset);
-        for (int i = 0; i < data.size(); i++)
-        {
-            result.push_back(make_pair(current->keys[i], String_to_Type<S>((data[i]))));
-        }
-        
-        current = current->next;
-    }
+    for (Cursor cursor = first(); cursor.valid(); cursor.next()) result.push_back(make_pair(cursor.key(), cursor.value()));
+    return result;
+}
+
+// up to limit pairs with keys bigger than after (from the smallest key without after), used to walk the tree in chunks
+template <typename T, typename S>
+vector<pair<T, S>> BPlusTree<T, S>::valuesAfter(const optional<T>& after, size_t limit){
+    vector<pair<T, S>> result;
+    Cursor cursor = after ? seek(*after) : first();
+    if (after && cursor.valid() && cursor.compare(*after) == 0) cursor.next();
+    for (; cursor.valid() && result.size() < limit; cursor.next()) result.push_back(make_pair(cursor.key(), cursor.value()));
     return result;
 }
 
 template <typename T, typename S>
 vector<T> BPlusTree<T, S>::getAllKeys(){
     vector<T> result;
-    if (root == nullptr) return result;
-    Node* current = root;
-    while (!current->isLeaf) {
-        current = current->children[0];
-    }
-    while (current != nullptr) {
-       
-        result.insert(result.end(),current->keys.begin(),current->keys.end()); 
-        current = current->next;
-    }
+    for (Cursor cursor = first(); cursor.valid(); cursor.next()) result.push_back(cursor.key());
     return result;
 }
 // Removal function implementation
@@ -436,7 +854,7 @@ void BPlusTree<T,S>::remove(const T& key)
     if (root->keys.empty() && !root->isLeaf) {
         Node* tmp = root;
         root = root->children[0];
-        delete tmp;
+        free_node(tmp);
     }
 }
 template <typename T, typename S>
@@ -445,40 +863,32 @@ T BPlusTree<T, S>::findSmallestInSubtree(Node* node) {
     while (!current->isLeaf) {
         current = current->children.front();
     }
-    return current->keys.front();
+    return key_at(current, 0);
 }
 
 template <typename T, typename S>
 void BPlusTree<T, S>::removeInternal(Node* node, const T& key) {
-    int idx = findKey(node, key);
     if (node->isLeaf) {
-        if (idx < node->keys.size() && node->keys[idx] == key) {
+        int idx = findKey(node, key);
+        if (key_is(node, idx, key)) {
             node->keys.erase(node->keys.begin() + idx);
-            vector<string> data = read_line_from_file(file_name, node->offset);
-            data.erase(data.begin() + idx);
-            node->offset = write_line_to_file(file_name, data);
+            node->values.erase(node->values.begin() + idx);
+            touch(node);
         }
         return;
     }
-    else{
-        if (idx < node->keys.size() && node->keys[idx] == key) {
-             removeInternal(node->children[idx + 1], key);
-        } else {
-             removeInternal(node->children[idx], key);
-        }
-    }// Key is not in this internal node, recurse down.
-        Node* child = node->children[idx];
-        if (child->keys.size() < t) {
-            fill(node, idx);
-        }
-        if (idx > 0) {
-            node->keys[idx - 1] = findSmallestInSubtree(node->children[idx]);
-        }
+    // Equal separator means the key is in the right subtree
+    int child_idx = bound<true>(node, key);
+    removeInternal(node->children[child_idx], key);
+    if (node->children[child_idx]->keys.size() < t) {
+        fill(node, child_idx);
+    }
+    // a separator only has to stay above its left subtree and not above its right one, which removing a key
+    // and borrowing or merging keep, so it is not reset to the smallest key of the right subtree
 }
 template <typename T, typename S>
 int BPlusTree<T, S>::findKey(Node* node, const T& key) {
-    auto it = lower_bound(node->keys.begin(), node->keys.end(), key);
-    return distance(node->keys.begin(), it);
+    return bound<false>(node, key);
 }
 template <typename T, typename S>
 void BPlusTree<T, S>::fill(Node* node, int index) {
@@ -499,27 +909,26 @@ template <typename T, typename S>
 void BPlusTree<T, S>::borrowFromPrev(Node* node, int index) {
     Node* child = node->children[index];
     Node* sibling = node->children[index - 1];
+    touch(node);
+    touch(child);
+    touch(sibling);
 
     if (child->isLeaf) {
         // Take last key from sibling.
-        child->keys.insert(child->keys.begin(), sibling->keys.back());
+        insert_key(child, 0, key_at(sibling, sibling->keys.size() - 1));
         sibling->keys.pop_back();
 
-        // Update parent key to the new first key of child
-        node->keys[index-1] = child->keys.front();
+        // Update parent key to separate the sibling from the new first key of child
+        set_key(node, index - 1, separator(key_at(sibling, sibling->keys.size() - 1), key_at(child, 0)));
 
-        // Update data files
-        auto child_data = read_line_from_file(file_name, child->offset);
-        auto sibling_data = read_line_from_file(file_name, sibling->offset);
-        child_data.insert(child_data.begin(), sibling_data.back());
-        sibling_data.pop_back();
-        child->offset = write_line_to_file(file_name, child_data);
-        sibling->offset = write_line_to_file(file_name, sibling_data);
+        // Move the value with its key
+        child->values.insert(child->values.begin(), sibling->values.back());
+        sibling->values.pop_back();
     } else {
         // For internal nodes
-        child->keys.insert(child->keys.begin(), node->keys[index - 1]);
+        insert_key(child, 0, key_at(node, index - 1));
         child->children.insert(child->children.begin(), sibling->children.back());
-        node->keys[index - 1] = sibling->keys.back();
+        set_key(node, index - 1, key_at(sibling, sibling->keys.size() - 1));
         sibling->keys.pop_back();
         sibling->children.pop_back();
     }
@@ -529,27 +938,26 @@ template <typename T, typename S>
 void BPlusTree<T, S>::borrowFromNext(Node* node, int index) {
     Node* child = node->children[index];
     Node* sibling = node->children[index + 1];
+    touch(node);
+    touch(child);
+    touch(sibling);
 
     if (child->isLeaf) {
-        child->keys.push_back(sibling->keys.front());
+        insert_key(child, child->keys.size(), key_at(sibling, 0));
         sibling->keys.erase(sibling->keys.begin());
 
-        // Update parent key to new first key of sibling
-        node->keys[index] = sibling->keys.front();
+        // Update parent key to separate child from the new first key of sibling
+        set_key(node, index, separator(key_at(child, child->keys.size() - 1), key_at(sibling, 0)));
         
-        // Update data files
-        auto child_data = read_line_from_file(file_name, child->offset);
-        auto sibling_data = read_line_from_file(file_name, sibling->offset);
-        child_data.push_back(sibling_data.front());
-        sibling_data.erase(sibling_data.begin());
-        child->offset = write_line_to_file(file_name, child_data);
-        sibling->offset = write_line_to_file(file_name, sibling_data);
+        // Move the value with its key
+        child->values.push_back(sibling->values.front());
+        sibling->values.erase(sibling->values.begin());
 
     } else {
         // For internal nodes
-        child->keys.push_back(node->keys[index]);
+        insert_key(child, child->keys.size(), key_at(node, index));
         child->children.push_back(sibling->children.front());
-        node->keys[index] = sibling->keys.front();
+        set_key(node, index, key_at(sibling, 0));
         sibling->keys.erase(sibling->keys.begin());
         sibling->children.erase(sibling->children.begin());
     }
@@ -562,27 +970,25 @@ void BPlusTree<T, S>::merge(Node* node, int index) {
 
     if (child->isLeaf) {
         // Append sibling's keys to child's keys
-        child->keys.insert(child->keys.end(), sibling->keys.begin(), sibling->keys.end());
-        
-        // Merge data from files
-        auto child_data = read_line_from_file(file_name, child->offset);
-        auto sibling_data = read_line_from_file(file_name, sibling->offset);
-        child_data.insert(child_data.end(), sibling_data.begin(), sibling_data.end());
-        child->offset = write_line_to_file(file_name, child_data);
+        for (size_t i = 0; i < sibling->keys.size(); i++) insert_key(child, child->keys.size(), key_at(sibling, i));
+
+        child->values.insert(child->values.end(), sibling->values.begin(), sibling->values.end());
 
         // Update linked list
         child->next = sibling->next;
     } else {
         // For internal nodes, pull down key from parent
-        child->keys.push_back(node->keys[index]);
-        child->keys.insert(child->keys.end(), sibling->keys.begin(), sibling->keys.end());
+        insert_key(child, child->keys.size(), key_at(node, index));
+        for (size_t i = 0; i < sibling->keys.size(); i++) insert_key(child, child->keys.size(), key_at(sibling, i));
         child->children.insert(child->children.end(), sibling->children.begin(), sibling->children.end());
     }
 
     // Remove key and pointer from parent
     node->keys.erase(node->keys.begin() + index);
     node->children.erase(node->children.begin() + index + 1);
-    delete sibling;
+    touch(node);
+    touch(child);
+    free_node(sibling);
 }
 
 
@@ -594,11 +1000,11 @@ void BPlusTree<T, S>::printTree(Node* node, int level) {
         cout << string(level * 4, ' ');
         cout << "[";
         for (size_t i = 0; i < node->keys.size(); ++i) {
-            cout << node->keys[i] << (i == node->keys.size() - 1 ? "" : ",");
+            cout << key_at(node, i) << (i == node->keys.size() - 1 ? "" : ",");
         }
         cout << "]";
         if (node->isLeaf) {
-            cout << " (Leaf, Offset: " << node->offset << ")" << endl;
+            cout << " (Leaf, " << node->values.size() << " values)" << endl;
         } else {
             cout << " (Internal)" << endl;
             for (Node* child : node->children) {
@@ -618,38 +1024,495 @@ void BPlusTree<T, S>::printTree() {
     }
     cout << "-------------------------" << endl;
 }
+//bulk load
+//builds the tree bottom up from (key, value) pairs in increasing key order, next returns false after the last one.
+//leaves and internal nodes are filled to 2t-1 keys (the last two of a level share what is left so none is below t-1).
+//the current content is replaced only after all of the input was read, if next throws the tree is unchanged
+template<typename T, typename S>
+void BPlusTree<T, S>::bulk_load(const function<bool(T&, S&)>& next) {
+    vector<Node*> level;
+    vector<T> first_keys; // separator in front of each node of level, used by the level above
+    const size_t max_keys = 2 * t - 1;
+    auto free_level = [&]() {
+        for (Node* node : level) free_subtree(node);
+    };
+    try {
+        T key;
+        S value;
+        while (next(key, value)) {
+            if (!level.empty() && !(level.back()->keys.back() < key)) {
+                throw invalid_argument(level.back()->keys.back() == key ? "Duplicate primary key." : "bulk load input is not sorted");
+            }
+            if (level.empty() || level.back()->keys.size() == max_keys) {
+                Node* leaf = make_node(true);
+                if (!level.empty()) level.back()->next = leaf;
+                level.push_back(leaf);
+            }
+            level.back()->keys.push_back(move(key));
+            level.back()->values.push_back(move(value));
+        }
+    } catch (...) {
+        free_level();
+        throw;
+    }
+    if (level.size() > 1 && level.back()->keys.size() < (size_t)(t - 1)) { // even out the last two leaves
+        Node* prev = level[level.size() - 2];
+        Node* last = level.back();
+        size_t total = prev->keys.size() + last->keys.size();
+        size_t move_count = prev->keys.size() - (total - total / 2);
+        last->keys.insert(last->keys.begin(), make_move_iterator(prev->keys.end() - move_count), make_move_iterator(prev->keys.end()));
+        last->values.insert(last->values.begin(), make_move_iterator(prev->values.end() - move_count), make_move_iterator(prev->values.end()));
+        prev->keys.resize(prev->keys.size() - move_count);
+        prev->values.resize(prev->values.size() - move_count);
+    }
+    // the leaves hold full keys until here
+    first_keys.resize(level.size());
+    for (size_t i = 1; i < level.size(); i++) first_keys[i] = separator(level[i - 1]->keys.back(), level[i]->keys.front());
+    for (Node* leaf : level) extend_prefix(leaf);
+    while (level.size() > 1) { // internal levels, up to 2t children per node
+        vector<Node*> parents;
+        vector<T> parent_first_keys;
+        for (size_t i = 0; i < level.size(); i++) {
+            if (parents.empty() || parents.back()->children.size() == max_keys + 1) {
+                parents.push_back(make_node(false));
+                parent_first_keys.push_back(first_keys[i]);
+            } else {
+                parents.back()->keys.push_back(first_keys[i]);
+            }
+            parents.back()->children.push_back(level[i]);
+        }
+        if (parents.size() > 1 && parents.back()->children.size() < (size_t)t) { // even out the last two nodes
+            Node* prev = parents[parents.size() - 2];
+            Node* last = parents.back();
+            size_t total = prev->children.size() + last->children.size();
+            size_t move_count = prev->children.size() - (total - total / 2);
+            size_t first_moved = prev->children.size() - move_count;
+            // the separator in front of the first moved child becomes the first key of the right node
+            vector<T> moved_keys(prev->keys.begin() + first_moved, prev->keys.end());
+            moved_keys.push_back(parent_first_keys.back());
+            parent_first_keys.back() = prev->keys[first_moved - 1];
+            last->keys.insert(last->keys.begin(), moved_keys.begin(), moved_keys.end());
+            last->children.insert(last->children.begin(), prev->children.begin() + first_moved, prev->children.end());
+            prev->keys.resize(first_moved - 1);
+            prev->children.resize(first_moved);
+        }
+        for (Node* parent : parents) extend_prefix(parent);
+        level = move(parents);
+        first_keys = move(parent_first_keys);
+    }
+    free_subtree(root);
+    root = level.empty() ? nullptr : level[0];
+}
+// the nodes loaded from a snapshot of an older version have the degree it was written with (MIN_DEGREE before
+// tables had a fanout), the tree is built again bottom up with its own degree
+template<typename T, typename S>
+void BPlusTree<T, S>::rebuild() {
+    vector<pair<T, S>> values = getAllValues();
+    size_t next = 0;
+    bulk_load([&](T& key, S& value) {
+        if (next == values.size()) return false;
+        key = move(values[next].first);
+        value = values[next++].second;
+        return true;
+    });
+}
 //serialzition functions
+//the tree is saved as a snapshot plus a delta log of the nodes changed since, both named by a generation:
+//<file_name>.<gen>.snap, <file_name>.<gen>.delta and <file_name>.manifest ("gen delta_bytes") which says which
+//of them are current. a checkpoint appends the dirty nodes to the delta and then swaps in a new manifest,
+//a full snapshot starts the next generation. nodes are identified by ids so a delta can replace single nodes.
+//node set: u64 number of nodes, u64 bytes of keys, u64 bytes of values, u64 number of child ids
+//    then per node u64 id + u32 number of keys + u32 number of children (0 for a leaf),
+//    then the keys of all nodes, the values of all leaves (put_snapshot_value) and the child ids (u64)
+//snapshot: "TSQLTREE" + u32 version, u64 root id, u64 next id, node set, u32 crc32 of everything before it
+//delta batch: u32 length + u32 crc32 of the rest, u64 root id, u64 next id, node set
+template<typename T, typename S>
+string BPlusTree<T, S>::encode_nodes(const vector<Node*>& nodes){
+    string node_array,keys,values,child_ids;
+    size_t child_count=0;
+    for(Node* node:nodes){
+        put_i64(node_array,node->id);
+        put_u32(node_array,node->keys.size());
+        put_u32(node_array,node->isLeaf?0:node->children.size());
+        for(const T& key:node->keys){ //full keys, the prefix is found again on load
+            if constexpr (truncated){
+                put_u32(keys,node->prefix.size()+key.size());
+                keys.append(node->prefix.view());
+                keys+=key;
+            }
+            else put_snapshot_value(keys,key);
+        }
+        if(node->isLeaf){
+            for(const S& value:node->values) put_snapshot_value(values,value);
+        }
+        else{
+            for(Node* child:node->children) put_i64(child_ids,child->id);
+            child_count+=node->children.size();
+        }
+    }
+    string out;
+    put_i64(out,nodes.size());
+    put_i64(out,keys.size());
+    put_i64(out,values.size());
+    put_i64(out,child_count);
+    out+=node_array;
+    out+=keys;
+    out+=values;
+    out+=child_ids;
+    return out;
+}
+//adds the nodes of a node set to loaded (indexed by id), a node that is already there is replaced by the newer version
 template<typename T, typename S>
-void BPlusTree<T, S>::serialize_Tree(){
-    ofstream serilaize_file("DB_files/"+file_name+"serialize.txt");
+bool BPlusTree<T, S>::decode_nodes(const char* p,const char* end,vector<LoadedNode>& loaded,vector<uint64_t>& child_ids){
+    if(end-p<4*(ptrdiff_t)sizeof(int64_t)) return false;
+    uint64_t node_count=get_i64(p),keys_size=get_i64(p+8),values_size=get_i64(p+16),child_count=get_i64(p+24);
+    p+=4*sizeof(int64_t);
+    const size_t entry_size=sizeof(int64_t)+2*sizeof(uint32_t);
+    if((uint64_t)(end-p)!=node_count*entry_size+keys_size+values_size+child_count*sizeof(int64_t)) return false;
+    const char* node_array=p;
+    const char* key_p=node_array+node_count*entry_size;
+    const char* keys_end=key_p+keys_size;
+    const char* value_p=keys_end;
+    const char* values_end=value_p+values_size;
+    const char* child_p=values_end;
+    bool ok=true;
+    for(size_t i=0;i<node_count&&ok;i++){
+        const char* entry=node_array+i*entry_size;
+        uint64_t id=get_i64(entry);
+        uint32_t key_count=get_u32(entry+sizeof(int64_t));
+        uint32_t children=get_u32(entry+sizeof(int64_t)+sizeof(uint32_t));
+        if(key_count>key_capacity()||children>key_capacity()+1||(children>0&&children!=key_count+1)) return false; //written with a bigger degree or damaged
+        Node* node=allocate_node(children==0);
+        node->id=id;
+        node->keys.resize(key_count);
+        for(T& key:node->keys) ok=ok&&get_snapshot_value(key_p,keys_end,key);
+        if(ok) extend_prefix(node);
+        if(node->isLeaf){
+            node->values.resize(key_count);
+            for(S& value:node->values) ok=ok&&get_snapshot_value(value_p,values_end,value);
+        }
+        else if(end-child_p<(ptrdiff_t)(children*sizeof(int64_t))) ok=false;
+        if(!ok||id==0||id>=loaded.size()){ //ids are below the next id the set was written with
+            release_node(node);
+            return false;
+        }
+        if(loaded[id].node) release_node(loaded[id].node);
+        loaded[id]={node,child_ids.size(),children};
+        for(uint32_t c=0;c<children;c++,child_p+=sizeof(int64_t)) child_ids.push_back(get_i64(child_p));
+    }
+    return ok;
+}
+//links the loaded nodes under root_id, chains the leaves and frees what is no longer reachable
+template<typename T, typename S>
+bool BPlusTree<T, S>::link_nodes(vector<LoadedNode>& loaded,const vector<uint64_t>& child_ids,uint64_t root_id){
+    bool ok=root_id==0||(root_id<loaded.size()&&loaded[root_id].node);
+    vector<bool> reachable(loaded.size(),false);
+    Node* prev_leaf=nullptr;
+    vector<uint64_t> stack;
+    if(ok&&root_id!=0) stack.push_back(root_id);
+    while(ok&&!stack.empty()){ //depth first, children pushed right to left so the leaves come in key order
+        uint64_t id=stack.back();
+        stack.pop_back();
+        LoadedNode& entry=loaded[id];
+        if(reachable[id]){ //a node can only have one parent
+            ok=false;
+            break;
+        }
+        reachable[id]=true;
+        if(entry.node->isLeaf){
+            if(prev_leaf) prev_leaf->next=entry.node;
+            prev_leaf=entry.node;
+            continue;
+        }
+        for(size_t c=entry.first_child;c<entry.first_child+entry.child_count;c++){
+            uint64_t child_id=child_ids[c];
+            if(child_id>=loaded.size()||!loaded[child_id].node){
+                ok=false;
+                break;
+            }
+            entry.node->children.push_back(loaded[child_id].node);
+        }
+        for(size_t c=entry.first_child+entry.child_count;ok&&c>entry.first_child;c--) stack.push_back(child_ids[c-1]);
+    }
+    for(size_t id=0;id<loaded.size();id++){
+        if(loaded[id].node&&(!ok||!reachable[id])) release_node(loaded[id].node);
+    }
+    if(ok) root=root_id?loaded[root_id].node:nullptr;
+    return ok;
+}
+//reads a whole file with one read
+inline bool read_whole_file(const string& path,string& content){
+    ifstream in(path,ios::binary|ios::ate);
+    if(!in) return false;
+    content.resize(in.tellg());
+    in.seekg(0);
+    in.read(content.data(),content.size());
+    return (bool)in;
+}
+//the temp manifest is synced before the rename and the directory after it, the snapshot and delta it names
+//must have been synced before. false if the manifest may not be on disk
+template<typename T, typename S>
+bool BPlusTree<T, S>::write_manifest(){
+    string temp_path=manifest_path()+".temp";
+    bool written;
+    {
+        ofstream out(temp_path,ios::trunc);
+        out<<generation<<" "<<delta_bytes<<endl;
+        written=out.good();
+    }
+    written=written&&sync_path(temp_path);
+    error_code ec;
+    if(written) filesystem::rename(temp_path,manifest_path(),ec);
+    if(!written||ec||!sync_path("DB_files")){
+        cerr<<"Error writing manifest: "<<manifest_path()<<endl;
+        return false;
+    }
+    return true;
+}
+//full snapshot, starts a new generation (used after GC rewrote all the values).
+//false if it was not written, the files of the old generation are only removed once the manifest names the new one
+template<typename T, typename S>
+bool BPlusTree<T, S>::serialize_Tree(){
+    vector<Node*> nodes;
     queue<Node*> visiting_queue;
-    visiting_queue.push(root);
+    if(root) visiting_queue.push(root);
     while(!visiting_queue.empty()){
         Node* node=visiting_queue.front();
-        string serialzed_node="";
-        //keys|isLeaf| and then for leaf will be offset and for internal nodes there will be num_of_children 
-        for(int i=0;i<node->keys.size()-1;i++){
-            serialzed_node+=Type_to_String(node->keys[i])+" ";
-        }
-        serialzed_node+=Type_to_String(node->keys[node->keys.size()-1])+"|";
-        if(node->isLeaf) {
-            serialzed_node+="1|"+Type_to_String(node->offset);
-        }
-        else{ 
-            serialzed_node+="0|";
-            for(int i=0;i<node->children.size();i++){
-                visiting_queue.push(node->children[i]);
-            }
-            serialzed_node+=Type_to_String<size_t>(node->children.size());
-        }
         visiting_queue.pop();
-        serilaize_file<<serialzed_node<<endl;
+        nodes.push_back(node);
+        if(!node->isLeaf){
+            for(Node* child:node->children) visiting_queue.push(child);
+        }
+    }
+    string snapshot("TSQLTREE");
+    put_u32(snapshot,SNAPSHOT_FORMAT_VERSION);
+    put_i64(snapshot,root?root->id:0);
+    put_i64(snapshot,next_id);
+    snapshot+=encode_nodes(nodes);
+    put_u32(snapshot,crc32(snapshot.data(),snapshot.size()));
+    uint64_t new_generation=generation+1;
+    {
+        ofstream out(snapshot_path(new_generation),ios::binary|ios::trunc);
+        out.write(snapshot.data(),snapshot.size());
+        ofstream delta(delta_path(new_generation),ios::binary|ios::trunc);
+        if(!out||!delta){
+            cerr<<"Error writing tree snapshot: "<<snapshot_path(new_generation)<<endl;
+            return false;
+        }
+    }
+    if(!sync_path(snapshot_path(new_generation))||!sync_path(delta_path(new_generation))){
+        cerr<<"Error syncing tree snapshot: "<<snapshot_path(new_generation)<<endl;
+        return false;
+    }
+    uint64_t old_generation=generation,old_delta_bytes=delta_bytes,old_snapshot_bytes=snapshot_bytes;
+    generation=new_generation;
+    delta_bytes=0;
+    snapshot_bytes=snapshot.size();
+    if(!write_manifest()){ //the new generation is current from here on
+        generation=old_generation;
+        delta_bytes=old_delta_bytes;
+        snapshot_bytes=old_snapshot_bytes;
+        return false;
+    }
+    error_code ec;
+    filesystem::remove(snapshot_path(old_generation),ec);
+    filesystem::remove(delta_path(old_generation),ec);
+    dirty_nodes.clear();
+    checkpoint_root=root?root->id:0;
+    //snapshots and leaf value file of older versions, everything is in the new snapshot now
+    filesystem::remove("DB_files/"+file_name+".snap",ec);
+    filesystem::remove("DB_files/"+file_name+"serialize.txt",ec);
+    if(filesystem::exists(FileManager::path_of(file_name))) file_manager.remove(file_name);
+    return true;
+}
+//writes the nodes changed since the last checkpoint, starts a new generation once the delta outgrows the snapshot.
+//false if the changes may not be on disk
+template<typename T, typename S>
+bool BPlusTree<T, S>::checkpoint(){
+    if(generation==0||delta_bytes>snapshot_bytes) return serialize_Tree();
+    uint64_t root_id=root?root->id:0;
+    if(dirty_nodes.empty()&&root_id==checkpoint_root) return true;
+    string batch;
+    put_u32(batch,0); //length and crc are patched in
+    put_u32(batch,0);
+    put_i64(batch,root_id);
+    put_i64(batch,next_id);
+    batch+=encode_nodes(vector<Node*>(dirty_nodes.begin(),dirty_nodes.end()));
+    uint32_t len=batch.size()-2*sizeof(uint32_t),crc=crc32(batch.data()+2*sizeof(uint32_t),len);
+    memcpy(batch.data(),&len,sizeof(len));
+    memcpy(batch.data()+sizeof(len),&crc,sizeof(crc));
+    bool written;
+    {
+        ofstream delta(delta_path(generation),ios::binary|ios::app);
+        delta.write(batch.data(),batch.size());
+        written=delta.good();
+    }
+    written=written&&sync_path(delta_path(generation));
+    if(!written) cerr<<"Error writing tree delta: "<<delta_path(generation)<<endl;
+    delta_bytes+=batch.size();
+    if(!written||!write_manifest()){
+        //the next delta is appended where this one started
+        delta_bytes-=batch.size();
+        error_code ec;
+        filesystem::resize_file(delta_path(generation),delta_bytes,ec);
+        return false;
     }
-    serilaize_file.close();
+    dirty_nodes.clear();
+    checkpoint_root=root_id;
+    return true;
+}
+//true if a checkpoint of any version was written under this name
+template<typename T, typename S>
+bool BPlusTree<T, S>::has_files(){
+    return has_binary_files()||filesystem::exists("DB_files/"+file_name+"serialize.txt");
+}
+//removes every file of the tree (of the generation in the manifest and of older versions)
+template<typename T, typename S>
+void BPlusTree<T, S>::remove_files(){
+    error_code ec;
+    uint64_t gen=generation;
+    if(gen==0){
+        ifstream manifest(manifest_path());
+        manifest>>gen;
+    }
+    filesystem::remove(snapshot_path(gen),ec);
+    filesystem::remove(delta_path(gen),ec);
+    filesystem::remove(manifest_path(),ec);
+    filesystem::remove("DB_files/"+file_name+".snap",ec);
+    filesystem::remove("DB_files/"+file_name+"serialize.txt",ec);
+    if(filesystem::exists(FileManager::path_of(file_name))) file_manager.remove(file_name);
 }
-// Helper for static_assert false in templates
 template<typename T, typename S>
 void BPlusTree<T, S>::deserialize_Tree(){
+    clear(); //a reload replaces every node
+    if(filesystem::exists(manifest_path())){
+        if(!load_checkpoint()) cerr<<"Tree checkpoint is corrupted: "<<manifest_path()<<endl;
+        return;
+    }
+    if(filesystem::exists("DB_files/"+file_name+".snap")){ //snapshot of the first binary version
+        if(!load_snapshot_v1("DB_files/"+file_name+".snap")) cerr<<"Tree snapshot is corrupted: "<<file_name<<".snap"<<endl;
+    }
+    else deserialize_text_Tree(); //written by an older version
+    rebuild();
+}
+//loads the snapshot of the current generation and applies its delta up to the length in the manifest
+template<typename T, typename S>
+bool BPlusTree<T, S>::load_checkpoint(){
+    uint64_t gen=0;
+    size_t valid_delta=0;
+    {
+        ifstream manifest(manifest_path());
+        if(!(manifest>>gen>>valid_delta)) return false;
+    }
+    string content;
+    if(!read_whole_file(snapshot_path(gen),content)) return false;
+    const size_t header_size=8+sizeof(uint32_t)+2*sizeof(int64_t);
+    if(content.size()<header_size+sizeof(uint32_t)||content.compare(0,8,"TSQLTREE")!=0) return false;
+    size_t body_end=content.size()-sizeof(uint32_t);
+    if(get_u32(content.data()+8)!=SNAPSHOT_FORMAT_VERSION||crc32(content.data(),body_end)!=get_u32(content.data()+body_end)) return false;
+    uint64_t root_id=get_i64(content.data()+8+sizeof(uint32_t));
+    uint64_t new_next_id=get_i64(content.data()+8+sizeof(uint32_t)+sizeof(int64_t));
+    vector<LoadedNode> loaded(new_next_id);
+    vector<uint64_t> child_ids;
+    bool ok=decode_nodes(content.data()+header_size,content.data()+body_end,loaded,child_ids);
+    snapshot_bytes=content.size();
+    string delta;
+    if(ok&&valid_delta>0) ok=read_whole_file(delta_path(gen),delta)&&delta.size()>=valid_delta;
+    for(size_t pos=0;ok&&pos<valid_delta;){
+        if(pos+2*sizeof(uint32_t)+2*sizeof(int64_t)>valid_delta){
+            ok=false;
+            break;
+        }
+        uint32_t len=get_u32(delta.data()+pos),crc=get_u32(delta.data()+pos+sizeof(uint32_t));
+        const char* start=delta.data()+pos+2*sizeof(uint32_t);
+        if(pos+2*sizeof(uint32_t)+len>valid_delta||crc32(start,len)!=crc){
+            ok=false;
+            break;
+        }
+        root_id=get_i64(start);
+        new_next_id=get_i64(start+sizeof(int64_t));
+        if(new_next_id>loaded.size()) loaded.resize(new_next_id);
+        ok=decode_nodes(start+2*sizeof(int64_t),start+len,loaded,child_ids);
+        pos+=2*sizeof(uint32_t)+len;
+    }
+    if(!ok){
+        for(LoadedNode& entry:loaded) if(entry.node) release_node(entry.node);
+        return false;
+    }
+    if(!link_nodes(loaded,child_ids,root_id)) return false;
+    //a checkpoint that crashed before its manifest may have left bytes after the valid part
+    if(delta.size()>valid_delta) filesystem::resize_file(delta_path(gen),valid_delta);
+    generation=gen;
+    delta_bytes=valid_delta;
+    next_id=new_next_id;
+    checkpoint_root=root_id;
+    dirty_nodes.clear();
+    return true;
+}
+//snapshot of the first binary version: nodes in BFS order without ids, children follow by their counts
+template<typename T, typename S>
+bool BPlusTree<T, S>::load_snapshot_v1(const string& path){
+    string content;
+    if(!read_whole_file(path,content)) return false;
+    const size_t header_size=8+sizeof(uint32_t)+3*sizeof(int64_t);
+    if(content.size()<header_size+sizeof(uint32_t)||content.compare(0,8,"TSQLTREE")!=0) return false;
+    size_t body_end=content.size()-sizeof(uint32_t);
+    if(get_u32(content.data()+8)!=1||crc32(content.data(),body_end)!=get_u32(content.data()+body_end)) return false;
+    const char* p=content.data()+8+sizeof(uint32_t);
+    uint64_t node_count=get_i64(p),keys_size=get_i64(p+8),values_size=get_i64(p+16);
+    const char* node_array=content.data()+header_size;
+    if(node_count*2*sizeof(uint32_t)+keys_size+values_size!=body_end-header_size) return false;
+    const char* key_p=node_array+node_count*2*sizeof(uint32_t);
+    const char* keys_end=key_p+keys_size;
+    const char* value_p=keys_end;
+    const char* values_end=value_p+values_size;
+    vector<Node*> nodes;
+    nodes.reserve(node_count);
+    bool ok=true;
+    size_t next_child=1;
+    for(size_t i=0;i<node_count&&ok;i++){
+        uint32_t key_count=get_u32(node_array+i*2*sizeof(uint32_t));
+        uint32_t child_count=get_u32(node_array+i*2*sizeof(uint32_t)+sizeof(uint32_t));
+        if(key_count>key_capacity()||child_count>key_capacity()+1){
+            ok=false;
+            break;
+        }
+        Node* node=make_node(child_count==0);
+        nodes.push_back(node);
+        node->keys.resize(key_count);
+        for(T& key:node->keys) ok=ok&&get_snapshot_value(key_p,keys_end,key);
+        if(node->isLeaf){
+            node->values.resize(key_count);
+            for(S& value:node->values) ok=ok&&get_snapshot_value(value_p,values_end,value);
+        }
+        else{
+            if(next_child+child_count>node_count) ok=false;
+            next_child+=child_count;
+        }
+    }
+    if(!ok){
+        for(Node* node:nodes) free_node(node);
+        return false;
+    }
+    size_t counter=1;
+    Node* prev_leaf=nullptr;
+    for(size_t i=0;i<node_count;i++){
+        Node* node=nodes[i];
+        if(node->isLeaf){
+            if(prev_leaf) prev_leaf->next=node;
+            prev_leaf=node;
+            continue;
+        }
+        uint32_t child_count=get_u32(node_array+i*2*sizeof(uint32_t)+sizeof(uint32_t));
+        node->children.assign(nodes.begin()+counter,nodes.begin()+counter+child_count);
+        counter+=child_count;
+    }
+    if(!nodes.empty()) root=nodes[0];
+    return true;
+}
+//text snapshot of older versions: keys|2|values for leaves (1|offset when the values were in a separate file), keys|0|num_of_children for internal nodes
+template<typename T, typename S>
+void BPlusTree<T, S>::deserialize_text_Tree(){
     if(!filesystem::exists("DB_files/"+file_name+"serialize.txt")) return;
     ifstream serialized_file("DB_files/"+file_name+"serialize.txt");
     vector<Node*> nodes;
@@ -662,23 +1525,31 @@ void BPlusTree<T, S>::deserialize_Tree(){
         while (std::getline(ss, token, '|')) {
             tokens.push_back(token);
         }
-        Node* new_node=new Node();
+        while(tokens.size()<3) tokens.push_back(""); //empty leaf
+        Node* new_node=make_node(tokens[1]=="2"||tokens[1]=="1");
         stringstream keys(tokens[0]);
         string key;
         while(std::getline(keys,key,' ')){
            new_node->keys.push_back(String_to_Type<T>(key)); //parse key as type T
         }
-        if(tokens[1]=="1"){ //check for leaf 1 means true
-            new_node->isLeaf=true;
-            new_node->offset=stoi(tokens[2]);
+        if(tokens[1]=="2"){ //leaf with its values
+            stringstream values(tokens[2]);
+            string value;
+            while(std::getline(values,value,' ')){
+                if(!value.empty()) new_node->values.push_back(String_to_Type<S>(value));
+            }
+        }
+        else if(tokens[1]=="1"){ //old leaf format, the values are in the leaf file at offset
+            vector<S> values=read_values_from_file<S>(file_name,streampos(stoll(tokens[2])));
+            new_node->values.assign(values.begin(),values.end());
         }
         else{
-            new_node->isLeaf=false;
             indices.push_back(tokens[2]);
         }
         nodes.push_back(new_node);
     }
     serialized_file.close();
+    if(nodes.empty()) return;
     int counter=1;
     for(int i=0;i<indices.size();i++){
         Node* curr=nodes[i];
@@ -700,13 +1571,14 @@ T BPlusTree<T, S>::get_Max(){
     Node* current=root;
     while(!current->isLeaf)
         current=current->children.back();
-    return current->keys.back();
+    return key_at(current,current->keys.size()-1);
 }
 template<typename T, typename S>
 T BPlusTree<T, S>::get_Min(){
    return findSmallestInSubtree(root);
 }
 //GC function implementation
+//values are the new values of all the keys in key order (after the data file was compacted)
 template<typename T, typename S>
 void BPlusTree<T, S>::GC_with_values(vector<S> values) {
     if (root == nullptr) return;
@@ -717,16 +1589,11 @@ void BPlusTree<T, S>::GC_with_values(vector<S> values) {
     int start_ind=0;
     while (current != nullptr) {
         int size=current->keys.size();
-        vector<string> data;
-        for(int i=0;i<size;i++){
-            data.push_back((Type_to_String<S>(values[start_ind + i])));
-        }
-        current->offset=write_line_to_file(file_name+'1', data); //rewrite to new location
+        current->values.assign(values.begin()+start_ind,values.begin()+start_ind+size);
+        touch(current);
         start_ind += size;
         current = current->next;
     }
-    filesystem::remove("DB_files/" + file_name + ".txt"); //delete old file
-    filesystem::rename("DB_files/" + file_name + "1.txt", "DB_files/" + file_name + ".txt"); //rename new file to old file
 }
 
 
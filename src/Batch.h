@@ -0,0 +1,223 @@
+#ifndef BATCH_H
+#define BATCH_H
+#define SCAN_BATCH_ROWS 1024 //rows a scan decodes and filters at a time
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Simd.h"
+#include "Where.h"
+using namespace std;
+//rows of a scan decoded by column: an int column is an int64 array, a string column string_views into the record bytes
+//of its row (or into owned for the key columns and text data files). filters run over a batch with selection vectors,
+//the row numbers that still pass in order, and only the rows that pass are turned into strings
+struct ColumnBatch{
+    vector<bool> is_int; //per column
+    vector<vector<int64_t>> ints; //per int column, SCAN_BATCH_ROWS long
+    vector<vector<string_view>> strs; //per string column
+    vector<string> keys; //encoded key of every row
+    vector<string> payloads; //record bytes of every row (when they arent read from the mapping)
+    vector<string> owned; //rows*columns, strings that are not in a payload
+    size_t rows=0;
+    void init(const vector<string>& types){
+        size_t columns=types.size();
+        is_int.assign(columns,false);
+        ints.assign(columns,{});
+        strs.assign(columns,{});
+        for(size_t c=0;c<columns;c++){
+            is_int[c]=types[c]=="I";
+            if(is_int[c]) ints[c].resize(SCAN_BATCH_ROWS);
+            else strs[c].resize(SCAN_BATCH_ROWS);
+        }
+        keys.resize(SCAN_BATCH_ROWS);
+        payloads.resize(SCAN_BATCH_ROWS);
+        owned.resize(SCAN_BATCH_ROWS*columns);
+        rows=0;
+    }
+    //sets column c of row r from text (an int is parsed, a string is copied to owned)
+    void set_text(size_t r,size_t c,const string& text){
+        if(is_int[c]){
+            int64_t v=0;
+            from_chars(text.data(),text.data()+text.size(),v);
+            ints[c][r]=v;
+        }
+        else{
+            string& slot=owned[r*is_int.size()+c];
+            slot=text;
+            strs[c][r]=slot;
+        }
+    }
+    //sets the first key_columns columns of row r from an encoded key, false if the bytes are not a key of them
+    bool set_key(size_t r,string_view key,size_t key_columns){
+        size_t p=0;
+        for(size_t c=0;c<key_columns;c++){
+            int64_t v=0;
+            string& slot=owned[r*is_int.size()+c];
+            if(!next_key_column(key,p,is_int[c],v,slot)) return false;
+            if(is_int[c]) ints[c][r]=v;
+            else strs[c][r]=slot;
+        }
+        return p==key.size();
+    }
+    void row(size_t r,vector<string>& out) const {
+        out.resize(is_int.size());
+        for(size_t c=0;c<is_int.size();c++) out[c]=is_int[c]?to_string(ints[c][r]):string(strs[c][r]);
+    }
+};
+
+//filter kernels: write the rows of sel (all n rows when sel is null) whose value passes op against the literal to out,
+//return how many. a dense int column is compared 4 rows at a time with AVX2 (2 with SSE4.2, as simd_level says), the
+//bits of the compare mask are written to out without a branch per row
+template<CmpOp op>
+inline bool int_passes(int64_t v,int64_t literal){
+    if constexpr (op==CmpOp::LT) return v<literal;
+    else if constexpr (op==CmpOp::LE) return v<=literal;
+    else if constexpr (op==CmpOp::EQ) return v==literal;
+    else if constexpr (op==CmpOp::NE) return v!=literal;
+    else if constexpr (op==CmpOp::GE) return v>=literal;
+    else return v>literal;
+}
+
+#ifdef SIMD_X86
+//the dense kernels stop before the last rows that dont fill a register and return the first row they left
+template<CmpOp op>
+TARGET_AVX2 size_t select_int_avx2(const int64_t* column,int64_t literal,size_t n,uint32_t* out,size_t& found){
+    size_t i=0;
+    __m256i needle=_mm256_set1_epi64x(literal);
+    for(;i+4<=n;i+=4){
+        __m256i block=_mm256_loadu_si256((const __m256i*)(column+i));
+        __m256i mask;
+        if constexpr (op==CmpOp::LT||op==CmpOp::GE) mask=_mm256_cmpgt_epi64(needle,block);
+        else if constexpr (op==CmpOp::GT||op==CmpOp::LE) mask=_mm256_cmpgt_epi64(block,needle);
+        else mask=_mm256_cmpeq_epi64(block,needle);
+        unsigned bits=_mm256_movemask_pd(_mm256_castsi256_pd(mask));
+        if constexpr (op==CmpOp::GE||op==CmpOp::LE||op==CmpOp::NE) bits^=0xF;
+        for(unsigned j=0;j<4;j++){
+            out[found]=i+j;
+            found+=(bits>>j)&1;
+        }
+    }
+    return i;
+}
+template<CmpOp op>
+TARGET_SSE42 size_t select_int_sse42(const int64_t* column,int64_t literal,size_t n,uint32_t* out,size_t& found){
+    size_t i=0;
+    __m128i needle=_mm_set1_epi64x(literal);
+    for(;i+2<=n;i+=2){
+        __m128i block=_mm_loadu_si128((const __m128i*)(column+i));
+        __m128i mask;
+        if constexpr (op==CmpOp::LT||op==CmpOp::GE) mask=_mm_cmpgt_epi64(needle,block);
+        else if constexpr (op==CmpOp::GT||op==CmpOp::LE) mask=_mm_cmpgt_epi64(block,needle);
+        else mask=_mm_cmpeq_epi64(block,needle);
+        unsigned bits=_mm_movemask_pd(_mm_castsi128_pd(mask));
+        if constexpr (op==CmpOp::GE||op==CmpOp::LE||op==CmpOp::NE) bits^=0x3;
+        out[found]=i;
+        found+=bits&1;
+        out[found]=i+1;
+        found+=bits>>1;
+    }
+    return i;
+}
+#endif
+
+template<CmpOp op>
+size_t select_int_column(const int64_t* column,int64_t literal,const uint32_t* sel,size_t n,uint32_t* out){
+    size_t found=0;
+    if(sel){
+        for(size_t i=0;i<n;i++){
+            out[found]=sel[i];
+            found+=int_passes<op>(column[sel[i]],literal);
+        }
+        return found;
+    }
+    size_t i=0;
+#ifdef SIMD_X86
+    if(simd_level==SimdLevel::AVX2) i=select_int_avx2<op>(column,literal,n,out,found);
+    else if(simd_level==SimdLevel::SSE42) i=select_int_sse42<op>(column,literal,n,out,found);
+#endif
+    for(;i<n;i++){
+        out[found]=i;
+        found+=int_passes<op>(column[i],literal);
+    }
+    return found;
+}
+
+inline size_t select_int_column(CmpOp op,const int64_t* column,int64_t literal,const uint32_t* sel,size_t n,uint32_t* out){
+    switch(op){
+        case CmpOp::LT: return select_int_column<CmpOp::LT>(column,literal,sel,n,out);
+        case CmpOp::LE: return select_int_column<CmpOp::LE>(column,literal,sel,n,out);
+        case CmpOp::EQ: return select_int_column<CmpOp::EQ>(column,literal,sel,n,out);
+        case CmpOp::NE: return select_int_column<CmpOp::NE>(column,literal,sel,n,out);
+        case CmpOp::GE: return select_int_column<CmpOp::GE>(column,literal,sel,n,out);
+        case CmpOp::GT: return select_int_column<CmpOp::GT>(column,literal,sel,n,out);
+    }
+    return 0;
+}
+
+template<typename Values>
+size_t select_compare(CmpOp op,const Values& values,string_view literal,const uint32_t* sel,size_t n,uint32_t* out){
+    size_t found=0;
+    for(size_t i=0;i<n;i++){
+        uint32_t r=sel?sel[i]:i;
+        out[found]=r;
+        found+=cmp_passes(op,string_view(values[r]).compare(literal));
+    }
+    return found;
+}
+
+//sel as a vector (0..n-1 when it is null)
+inline vector<uint32_t> selection_of(const uint32_t* sel,size_t n){
+    vector<uint32_t> all(n);
+    for(size_t i=0;i<n;i++) all[i]=sel?sel[i]:i;
+    return all;
+}
+
+//rows of sel (all the rows of batch when sel is null) that pass node of filter, AND narrows the selection clause by clause,
+//OR merges the selections of its children and NOT keeps the rows its child dropped
+size_t select_batch(const RowFilter& filter,int at,const ColumnBatch& batch,const uint32_t* sel,size_t n,uint32_t* out){
+    const RowFilter::Node& node=filter.nodes[at];
+    switch(node.kind){
+        case WhereExpr::AND:{
+            vector<uint32_t> current;
+            for(int child:node.children){
+                n=select_batch(filter,child,batch,sel,n,out);
+                if(n==0) return 0;
+                current.assign(out,out+n);
+                sel=current.data();
+            }
+            return n;
+        }
+        case WhereExpr::OR:{
+            vector<uint32_t> all=selection_of(sel,n),part(n),merged,result;
+            for(int child:node.children){
+                size_t found=select_batch(filter,child,batch,all.data(),n,part.data());
+                merged.clear();
+                set_union(result.begin(),result.end(),part.begin(),part.begin()+found,back_inserter(merged));
+                result.swap(merged);
+            }
+            copy(result.begin(),result.end(),out);
+            return result.size();
+        }
+        case WhereExpr::NOT:{
+            vector<uint32_t> all=selection_of(sel,n),dropped(n);
+            size_t found=select_batch(filter,node.children[0],batch,all.data(),n,dropped.data());
+            return set_difference(all.begin(),all.end(),dropped.begin(),dropped.begin()+found,out)-out;
+        }
+        case WhereExpr::CLAUSE:
+            break;
+    }
+    if(node.column<0) return select_compare(node.op,batch.keys,node.str_value,sel,n,out);
+    if(node.is_int) return select_int_column(node.op,batch.ints[node.column].data(),node.int_value,sel,n,out);
+    return select_compare(node.op,batch.strs[node.column],node.str_value,sel,n,out);
+}
+
+//the rows of batch that pass filter, in order
+size_t select_batch(const RowFilter& filter,const ColumnBatch& batch,uint32_t* out){
+    if(filter.root<0){
+        for(size_t i=0;i<batch.rows;i++) out[i]=i;
+        return batch.rows;
+    }
+    return select_batch(filter,filter.root,batch,nullptr,batch.rows,out);
+}
+#endif
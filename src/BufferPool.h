@@ -0,0 +1,215 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+#define PAGE_SIZE 8192 //storage files are read and written in pages of this size
+#define DEFAULT_BUFFER_POOL_MB 64
+#include <unistd.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+//syscalls made by the storage layer (buffer pool and storage files), atomic as parallel scans read on many threads
+struct IO_stats{
+    atomic<size_t> opens=0;
+    atomic<size_t> closes=0;
+    atomic<size_t> reads=0;
+    atomic<size_t> writes=0;
+    atomic<size_t> maps=0; //mmap and munmap calls
+    void reset(){ opens=closes=reads=writes=maps=0; }
+    size_t total() const { return opens+closes+reads+writes+maps; }
+};
+inline IO_stats io_stats;
+
+//what the pool needs to know about a file, a file is a sequence of PAGE_SIZE pages
+struct DiskFile{
+    int fd=-1;
+    off_t disk_size=0; //bytes the kernel has, dirty pages are written in order so this is always a prefix
+    set<size_t> dirty_pages;
+};
+
+struct PoolStats{
+    size_t hits=0;
+    size_t misses=0;
+    size_t evictions=0;
+    size_t write_backs=0; //pages written to the file
+    void reset(){ hits=misses=evictions=write_backs=0; }
+};
+
+//fixed number of page frames shared by all storage files, replacement is CLOCK.
+//a fetched page is pinned and cant be evicted until it is unpinned
+class BufferPool{
+public:
+    struct Frame{
+        char* data=nullptr;
+        size_t valid=0; //bytes of the page that hold file data
+        DiskFile* file=nullptr;
+        size_t page_no=0;
+        int pin_count=0;
+        bool dirty=false;
+        bool referenced=false;
+    };
+private:
+    struct PageKey{
+        DiskFile* file;
+        size_t page_no;
+        bool operator==(const PageKey& other) const { return file==other.file&&page_no==other.page_no; }
+    };
+    struct PageKeyHash{
+        size_t operator()(const PageKey& k) const { return hash<DiskFile*>()(k.file)^(k.page_no*0x9e3779b97f4a7c15ULL); }
+    };
+    vector<Frame> frames;
+    unique_ptr<char[]> memory;
+    unordered_map<PageKey,size_t,PageKeyHash> page_table;
+    size_t hand=0;
+    size_t victim(){
+        for(size_t step=0;step<2*frames.size();step++){
+            size_t idx=hand;
+            hand=(hand+1)%frames.size();
+            Frame& frame=frames[idx];
+            if(frame.file==nullptr) return idx;
+            if(frame.pin_count>0) continue;
+            if(frame.referenced){
+                frame.referenced=false;
+                continue;
+            }
+            return idx;
+        }
+        throw runtime_error("buffer pool exhausted, all pages are pinned");
+    }
+    void read_page(Frame& frame){
+        frame.valid=0;
+        off_t start=(off_t)frame.page_no*PAGE_SIZE;
+        if(start>=frame.file->disk_size) return; //page only exists in memory for now
+        size_t want=min<off_t>(PAGE_SIZE,frame.file->disk_size-start);
+        while(frame.valid<want){
+            ssize_t n=::pread(frame.file->fd,frame.data+frame.valid,want-frame.valid,start+frame.valid);
+            io_stats.reads++;
+            if(n<0&&errno==EINTR) continue;
+            if(n<=0) break;
+            frame.valid+=n;
+        }
+    }
+    bool write_run(DiskFile& file,size_t first_page,vector<iovec>& run){
+        off_t offset=(off_t)first_page*PAGE_SIZE;
+        size_t total=0;
+        for(const iovec& v:run) total+=v.iov_len;
+        size_t done=0;
+        while(done<total){
+            //skip what was already written
+            vector<iovec> rest;
+            size_t skip=done;
+            for(const iovec& v:run){
+                if(skip>=v.iov_len){ skip-=v.iov_len; continue; }
+                rest.push_back({(char*)v.iov_base+skip,v.iov_len-skip});
+                skip=0;
+            }
+            ssize_t n=::pwritev(file.fd,rest.data(),rest.size(),offset+done);
+            io_stats.writes++;
+            if(n<0){
+                if(errno==EINTR) continue;
+                cerr<<"Error writing pages to file"<<endl;
+                return false;
+            }
+            done+=n;
+        }
+        file.disk_size=max<off_t>(file.disk_size,offset+total);
+        return true;
+    }
+public:
+    PoolStats stats;
+    explicit BufferPool(size_t bytes=(size_t)DEFAULT_BUFFER_POOL_MB<<20){ resize(bytes); }
+    size_t capacity() const { return frames.size()*PAGE_SIZE; }
+    //drops every cached page, dirty pages must have been flushed by their files before
+    void resize(size_t bytes){
+        for(const Frame& frame:frames){
+            if(frame.pin_count>0||frame.dirty) throw runtime_error("cant resize buffer pool while pages are in use");
+        }
+        size_t num_frames=max<size_t>(bytes/PAGE_SIZE,2);
+        frames.assign(num_frames,Frame());
+        memory.reset(new char[num_frames*PAGE_SIZE]);
+        for(size_t i=0;i<num_frames;i++) frames[i].data=memory.get()+i*PAGE_SIZE;
+        page_table.clear();
+        hand=0;
+    }
+    //returns the page pinned, reads it from the file if it is not cached
+    Frame* fetch(DiskFile& file,size_t page_no){
+        auto it=page_table.find({&file,page_no});
+        if(it!=page_table.end()){
+            Frame& frame=frames[it->second];
+            frame.pin_count++;
+            frame.referenced=true;
+            stats.hits++;
+            return &frame;
+        }
+        stats.misses++;
+        size_t idx=victim();
+        Frame& frame=frames[idx];
+        if(frame.file){
+            if(frame.dirty&&!flush_file(*frame.file)) throw runtime_error("cant write back a dirty page"); //keep the file a prefix on disk
+            page_table.erase({frame.file,frame.page_no});
+            stats.evictions++;
+        }
+        frame.file=&file;
+        frame.page_no=page_no;
+        frame.pin_count=1;
+        frame.dirty=false;
+        frame.referenced=true;
+        read_page(frame);
+        page_table[{&file,page_no}]=idx;
+        return &frame;
+    }
+    void unpin(Frame* frame,bool dirty){
+        if(dirty&&!frame->dirty){
+            frame->dirty=true;
+            frame->file->dirty_pages.insert(frame->page_no);
+        }
+        frame->pin_count--;
+    }
+    //writes the dirty pages of the file in page order, consecutive pages with one pwritev.
+    //false if a write failed, the pages from the failed run on stay dirty so the file is still a prefix on disk
+    bool flush_file(DiskFile& file){
+        vector<iovec> run;
+        vector<Frame*> run_frames;
+        size_t first_page=0;
+        auto write=[&]{
+            if(!write_run(file,first_page,run)) return false;
+            for(Frame* frame:run_frames){
+                frame->dirty=false;
+                file.dirty_pages.erase(frame->page_no);
+                stats.write_backs++;
+            }
+            run.clear();
+            run_frames.clear();
+            return true;
+        };
+        vector<size_t> pages(file.dirty_pages.begin(),file.dirty_pages.end());
+        for(size_t page_no:pages){
+            Frame& frame=frames[page_table.at({&file,page_no})];
+            bool contiguous=!run.empty()&&page_no==first_page+run.size()&&run.back().iov_len==PAGE_SIZE;
+            if(!run.empty()&&(!contiguous||run.size()==IOV_MAX)&&!write()) return false;
+            if(run.empty()) first_page=page_no;
+            run.push_back({frame.data,frame.valid});
+            run_frames.push_back(&frame);
+        }
+        return run.empty()||write();
+    }
+    //flushes and forgets every page of the file (file is being closed, pages that cant be written are lost)
+    void drop_file(DiskFile& file){
+        flush_file(file);
+        for(size_t idx=0;idx<frames.size();idx++){
+            Frame& frame=frames[idx];
+            if(frame.file!=&file) continue;
+            page_table.erase({frame.file,frame.page_no});
+            frame=Frame{frame.data};
+        }
+    }
+};
+inline BufferPool buffer_pool;
+#endif
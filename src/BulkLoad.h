@@ -0,0 +1,173 @@
+#ifndef BULK_LOAD_H
+#define BULK_LOAD_H
+#define LOAD_RUN_ROWS (1<<20) //rows sorted in memory at once by LOAD, bigger inputs are sorted in runs on disk and merged
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BPlusTree.h"
+#include "TaskPool.h"
+using namespace std;
+inline size_t load_run_rows=LOAD_RUN_ROWS;
+
+//a row of a LOAD file, the key encoded like the index keeps it, columns without quotes like add_record keeps them
+struct LoadRow{
+    string key;
+    vector<string> values;
+};
+
+//splits a CSV (delim ',') or TSV (delim '\t') line, fields may be quoted with "" for a quote inside
+//(quoted fields cant span lines)
+bool split_delimited(const string& line,char delim,vector<string>& fields){
+    fields.clear();
+    string field;
+    size_t i=0;
+    while(true){
+        field.clear();
+        if(i<line.size()&&line[i]=='"'){
+            i++;
+            while(true){
+                if(i>=line.size()) return false; //no closing quote
+                if(line[i]=='"'){
+                    if(i+1<line.size()&&line[i+1]=='"'){
+                        field+='"';
+                        i+=2;
+                        continue;
+                    }
+                    i++;
+                    break;
+                }
+                field+=line[i++];
+            }
+            if(i<line.size()&&line[i]!=delim) return false;
+        }
+        else{
+            size_t end=line.find(delim,i);
+            if(end==string::npos) end=line.size();
+            field.assign(line,i,end-i);
+            i=end;
+        }
+        fields.push_back(field);
+        if(i>=line.size()) return true;
+        i++; //the delimiter
+    }
+}
+
+//reads the rows of a CSV/TSV file in key order. an input of up to load_run_rows rows is sorted in memory,
+//a bigger one is cut into sorted runs written to DB_files and merged while the rows are read
+class SortedRowReader{
+    struct Run{
+        ifstream in;
+        LoadRow row;
+    };
+    vector<LoadRow> rows; //the rows when everything fit in one run
+    size_t next_row=0;
+    vector<string> run_paths;
+    vector<unique_ptr<Run>> runs;
+    struct RunGreater{
+        bool operator()(const Run* a,const Run* b) const { return b->row.key<a->row.key; }
+    };
+    priority_queue<Run*,vector<Run*>,RunGreater> heap;
+    string buf;
+    bool read_run_row(Run& run){
+        char len_bytes[sizeof(uint32_t)];
+        if(!run.in.read(len_bytes,sizeof(len_bytes))) return false;
+        buf.resize(get_u32(len_bytes));
+        if(!run.in.read(buf.data(),buf.size())) return false;
+        const char* p=buf.data();
+        const char* end=p+buf.size();
+        return get_snapshot_value(p,end,run.row.key)&&get_snapshot_value(p,end,run.row.values);
+    }
+    void write_run(const string& prefix){
+        parallel_sort(rows.begin(),rows.end(),[](const LoadRow& a,const LoadRow& b){ return a.key<b.key; });
+        string path=prefix+to_string(run_paths.size())+".tmp";
+        run_paths.push_back(path);
+        ofstream out(path,ios::binary|ios::trunc);
+        string record;
+        for(const LoadRow& row:rows){
+            record.clear();
+            put_snapshot_value(record,row.key);
+            put_snapshot_value(record,row.values);
+            string len;
+            put_u32(len,record.size());
+            out<<len<<record;
+        }
+        if(!out) throw invalid_argument("cant write sort run "+path);
+        rows.clear();
+    }
+public:
+    //column_names in table order, key_size columns of them are the key
+    SortedRowReader(const string& path,const vector<string>& column_names,const vector<string>& column_types,int key_size,const string& run_prefix){
+        ifstream in(path);
+        if(!in) throw invalid_argument("cant open file "+path);
+        char delim=path.size()>=4&&path.compare(path.size()-4,4,".tsv")==0?'\t':',';
+        string line;
+        vector<string> fields;
+        size_t line_no=0;
+        try{
+            while(getline(in,line)){
+                line_no++;
+                if(!line.empty()&&line.back()=='\r') line.pop_back();
+                if(line.empty()) continue;
+                if(!split_delimited(line,delim,fields)) throw invalid_argument("bad quoting in line "+to_string(line_no)+" of "+path);
+                if(line_no==1&&fields==column_names) continue; //header
+                if(fields.size()!=column_types.size()){
+                    throw invalid_argument("line "+to_string(line_no)+" of "+path+" has "+to_string(fields.size())+" columns, table has "+to_string(column_types.size()));
+                }
+                LoadRow row;
+                vector<string> key_columns;
+                for(size_t i=0;i<fields.size();i++){
+                    if(column_types[i]=="I"){
+                        long long value;
+                        const char* end=fields[i].data()+fields[i].size();
+                        auto [ptr,ec]=from_chars(fields[i].data(),end,value);
+                        if(ec!=errc()||ptr!=end||fields[i].empty()) throw invalid_argument("Type mismatch in column number "+to_string(i+1)+" in line "+to_string(line_no));
+                    }
+                    if((int)i<key_size) key_columns.push_back(move(fields[i]));
+                    else row.values.push_back(move(fields[i]));
+                }
+                row.key=encode_key(key_columns,column_types);
+                rows.push_back(move(row));
+                if(rows.size()>=load_run_rows) write_run(run_prefix);
+            }
+            if(!run_paths.empty()&&!rows.empty()) write_run(run_prefix);
+        }
+        catch(...){
+            for(const string& run_path:run_paths) filesystem::remove(run_path);
+            throw;
+        }
+        if(run_paths.empty()){
+            parallel_sort(rows.begin(),rows.end(),[](const LoadRow& a,const LoadRow& b){ return a.key<b.key; });
+            return;
+        }
+        for(const string& run_path:run_paths){
+            auto run=make_unique<Run>();
+            run->in.open(run_path,ios::binary);
+            if(read_run_row(*run)) heap.push(run.get());
+            runs.push_back(move(run));
+        }
+    }
+    SortedRowReader(const SortedRowReader&)=delete;
+    SortedRowReader& operator=(const SortedRowReader&)=delete;
+    ~SortedRowReader(){
+        runs.clear();
+        for(const string& run_path:run_paths) filesystem::remove(run_path);
+    }
+    bool next(LoadRow& row){
+        if(run_paths.empty()){
+            if(next_row>=rows.size()) return false;
+            row=move(rows[next_row++]);
+            return true;
+        }
+        if(heap.empty()) return false;
+        Run* run=heap.top();
+        heap.pop();
+        row=move(run->row);
+        if(read_run_row(*run)) heap.push(run);
+        return true;
+    }
+};
+#endif
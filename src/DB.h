@@ -1,9 +1,43 @@
 #ifndef DB_H
 #define DB_H
-#define NUM_OF_OPS_FOR_GC 1000 //number of insert/delete operations after which GC is triggered
+#define NUM_OF_OPS_FOR_GC 1000 //inserts/deletes on a table after which its garbage is checked
 #define NUM_OF_OPS_FOR_GLOB_GC 5000
+#define CHECKPOINT_FILE "DB_files/DB_checkpoint.txt" //last lsn covered by the serialized trees and data files
+#define COMPACTION_CHUNK_ROWS 1024 //rows copied by the background compaction each time it takes the lock
+#define DEFAULT_COMPACTION_MB_PER_S 32 //bandwidth the background compaction may use for copying
+#define DEFAULT_COMPACTION_DEAD_RATIO 0.5 //share of a data file that is garbage before the table is compacted
+#define DEFAULT_COMPACTION_DEAD_MB 256 //garbage that gets a table compacted whatever its share
+#define DATA_SEGMENT_MB 64 //size of a data file segment before the next one is started
+#define COMPACTION_MAX_SEGMENTS 8 //segments rewritten by one background compaction
+#define DEFAULT_FANOUT 64 //children of an index node when CREATE doesnt give WITH (fanout=N)
+#define MAX_FANOUT 1024
+#define SCAN_MORSEL_ROWS 16384 //about the rows of one part of a parallel scan (the part is cut at leaves of the index)
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <unordered_map>
 #include "BPlusTree.h"
+#include "PrimaryIndex.h"
+#include "Record.h"
+#include "WAL.h"
+#include "BulkLoad.h"
+#include "Where.h"
+#include "Batch.h"
+#include "TaskPool.h"
+inline size_t compaction_chunk_rows=COMPACTION_CHUNK_ROWS;
+inline double compaction_mb_per_s=DEFAULT_COMPACTION_MB_PER_S; //0 for no limit
+inline double compaction_dead_ratio=DEFAULT_COMPACTION_DEAD_RATIO;
+inline size_t compaction_dead_mb=DEFAULT_COMPACTION_DEAD_MB;
+inline size_t compaction_max_segments=COMPACTION_MAX_SEGMENTS;
+inline size_t data_segment_bytes=(size_t)DATA_SEGMENT_MB<<20;
+inline size_t scan_threads=max(1u,thread::hardware_concurrency()); //pool threads one scan keeps busy, 1 for no parallel scan
+inline size_t scan_morsel_rows=SCAN_MORSEL_ROWS;
+
 bool check_Type(const string& value,const string& type){
     int size=value.size();
     if(size>=2 && value[0]=='\"'&&value[size-1]=='\"') return type=="S";
@@ -16,6 +50,52 @@ bool check_Type(const string& value,const string& type){
     }
 }
 
+//rows of INSERT (val1 ... valn) (val1 ... valn) ... TO table_name, a single row INSERT val1 ... valn TO table_name is one row.
+//the parentheses are on the first and last value of a row or tokens of their own
+vector<vector<string>> parse_insert_rows(const vector<string>& add_command){
+    vector<vector<string>> rows;
+    int end=add_command.size()-2; //TO table_name
+    if(end<1||add_command[1].empty()||add_command[1][0]!='('){
+        rows.emplace_back(add_command.begin()+1,add_command.begin()+max(end,1));
+        return rows;
+    }
+    bool in_row=false;
+    for(int i=1;i<end;i++){
+        string token=add_command[i];
+        if(!token.empty()&&token[0]=='('){
+            if(in_row) throw invalid_argument("Invalid INSERT command (rows should be (val1 ... valn) (val1 ... valn) ... TO table_name)");
+            in_row=true;
+            rows.emplace_back();
+            token.erase(0,1);
+        }
+        if(!in_row) throw invalid_argument("Invalid INSERT command (rows should be (val1 ... valn) (val1 ... valn) ... TO table_name)");
+        bool row_end=!token.empty()&&token.back()==')'; //a value ends with a quote or a digit, never with )
+        if(row_end) token.pop_back();
+        if(!token.empty()) rows.back().push_back(token);
+        if(row_end) in_row=false;
+    }
+    if(in_row) throw invalid_argument("Invalid INSERT command (rows should be (val1 ... valn) (val1 ... valn) ... TO table_name)");
+    return rows;
+}
+
+//the KEY clauses of a WHERE intersected into one interval of encoded keys, the scan seeks lower once and
+//walks the leaves up to upper. != keys are kept aside and skipped on the way (no key is looked up while planning)
+struct KeyRange{
+    optional<string> lower; //first key of the interval, the smallest key of the table without it
+    optional<string> upper; //last key of the interval
+    set<string> excluded;
+    bool empty() const { return lower&&upper&&*lower>*upper; }
+    void intersect(const string& op,const string& key){
+        if(op==">="||op==">"||op=="=="){
+            if(!lower||*lower<key) lower=key;
+        }
+        if(op=="<="||op=="<"||op=="=="){
+            if(!upper||*upper>key) upper=key;
+        }
+        if(op=="!="||op==">"||op=="<") excluded.insert(key);
+    }
+};
+
 class Schema{
 public:
     string schema_name;
@@ -23,13 +103,28 @@ public:
     vector<string> column_types; // "int" or "string" can be optimized for boolean
     int primary_key_size; //PK will always be at the start of the record and the size will signal how many columns are in the PK
     int number_of_columns;
-    BPlusTree<vector<string>,streampos>* index_tree; //BPlus tree to manage the index // Count of insert/delete operations
+    vector<string> data_column_types; //types of the columns saved in the data file (all but the key)
+    bool text_data_file=false; //data file still in the old text format, upgraded by the next GC
+    size_t live_rows=0; //rows the index points to
+    size_t live_bytes=0; //bytes of their records, the rest of the data file (but the header) is garbage
+    size_t ops_since_check=0; //inserts/deletes since the garbage was last checked
+    size_t compactions=0;
+    int fanout=DEFAULT_FANOUT; //most children of an index node (the tree degree is half of it)
+    unique_ptr<PrimaryIndex> index_tree; //BPlus tree to manage the index, keys encoded with encode_key (an int64 tree for one int key column)
+    TreeIndex<int64_t>* int_index=nullptr; //index_tree when it is an int64 tree, INSERT and DELETE use its int keys directly
     Schema(){}
+    //the schema owns its index, it is moved into the map and never copied
+    Schema(const Schema&)=delete;
+    Schema& operator=(const Schema&)=delete;
+    Schema(Schema&&)=default;
+    Schema& operator=(Schema&&)=default;
     Schema(const vector<string>& command,const int& command_size,const string& schema_name):schema_name(schema_name),primary_key_size(0),number_of_columns(0){
         auto it=find(command.begin(),command.end(),"KEY");
         if(it==command.end()) throw invalid_argument("Primary key definition missing");
+        auto key_end=find(it,command.end(),"WITH");
+        if(key_end!=command.end()) parse_options(vector<string>(key_end+1,command.end()));
         ++it;
-        if(it==command.end()) throw invalid_argument("Invalid primary key definition.(No columns specified)");
+        if(it==key_end) throw invalid_argument("Invalid primary key definition.(No columns specified)");
         int idx=2;
         while(idx<command_size && command[idx]!="KEY"){
             string col_def=command[idx];
@@ -42,7 +137,7 @@ public:
             if(col_type!="I" && col_type!="S"){
                 throw invalid_argument("Unsupported column type: "+col_type);
             }
-            if(it!=command.end()){
+            if(it!=key_end){
                 if(col_name!=*it) throw invalid_argument("Primary key columns must be at the start of the schema definition or columns dont match.");
                 ++it;
                 primary_key_size++;
@@ -56,7 +151,205 @@ public:
         if(primary_key_size>number_of_columns){
             throw invalid_argument("Primary key size exceeds number of columns.");
         }
-        index_tree=new BPlusTree<vector<string>,streampos>(MIN_DEGREE,schema_name);
+        data_column_types.assign(column_types.begin()+primary_key_size,column_types.end());
+        index_tree=make_primary_index(vector<string>(column_types.begin(),column_types.begin()+primary_key_size),schema_name,fanout/2);
+        int_index=dynamic_cast<TreeIndex<int64_t>*>(index_tree.get());
+    }
+    //the options after WITH: (fanout=N) with N even from 4 to MAX_FANOUT, the parentheses may be tokens of their own
+    void parse_options(const vector<string>& tokens){
+        string options;
+        for(const string& token:tokens) options+=token;
+        if(options.size()<2||options.front()!='('||options.back()!=')') throw invalid_argument("Invalid table options (should be WITH (fanout=N))");
+        stringstream ss(options.substr(1,options.size()-2));
+        string option;
+        while(getline(ss,option,',')){
+            size_t pos=option.find('=');
+            string name=option.substr(0,pos);
+            if(name!="fanout"||pos==string::npos) throw invalid_argument("Unknown table option "+name);
+            string value=option.substr(pos+1);
+            auto [ptr,ec]=from_chars(value.data(),value.data()+value.size(),fanout);
+            if(ec!=errc()||ptr!=value.data()+value.size()||fanout<4||fanout>MAX_FANOUT||fanout%2!=0){
+                throw invalid_argument("fanout must be an even number from 4 to "+to_string(MAX_FANOUT));
+            }
+        }
+    }
+    string data_file() const { return schema_name+"_data"; }
+    //the data file is cut into segments: <table>_data is segment 0 (the only file of older versions), <table>_data_<n> segment n.
+    //rows are appended to the active segment, a full one is sealed and a new one started.
+    //every segment counts its live rows and bytes, compaction rewrites only the segments with the most garbage
+    struct Segment{
+        size_t live_rows=0;
+        size_t live_bytes=0;
+    };
+    map<uint32_t,Segment> segments{{0,Segment()}};
+    uint32_t active_segment=0;
+    string segment_file(uint32_t segment) const { return segment==0?data_file():data_file()+"_"+to_string(segment); }
+    StorageFile& segment_data(uint32_t segment){ return file_manager.get(segment_file(segment)); }
+    //the segment new rows go to
+    uint32_t append_segment(){
+        if(segment_data(active_segment).size()>=(off_t)data_segment_bytes){
+            active_segment=segments.rbegin()->first+1;
+            segments[active_segment];
+        }
+        return active_segment;
+    }
+    streampos append_record(const string& file,const vector<string>& values){
+        StorageFile& data=file_manager.get(file);
+        if(!data.is_open()) return streampos(-1);
+        if(data.size()==0) data.append(data_file_header());
+        return streampos(data.append(encode_record(values,data_column_types)));
+    }
+    //appends the records with one write, returns their offsets in the same order
+    vector<streampos> append_records(const string& file,const vector<vector<string>>& rows){
+        StorageFile& data=file_manager.get(file);
+        if(!data.is_open()) return vector<streampos>(rows.size(),streampos(-1));
+        string buf=data.size()==0?data_file_header():"";
+        off_t base=data.size();
+        vector<streampos> offsets;
+        offsets.reserve(rows.size());
+        for(const vector<string>& values:rows){
+            offsets.push_back(streampos(base+buf.size()));
+            buf+=encode_record(values,data_column_types);
+        }
+        data.append(buf);
+        return offsets;
+    }
+    //appends a row to the active segment and counts it as live, returns its pointer
+    streampos append_row(const vector<string>& values){
+        uint32_t segment=append_segment();
+        off_t before=segment_data(segment).size();
+        streampos offset=append_record(segment_file(segment),values);
+        if(offset==streampos(-1)) return offset;
+        add_live(segment,before,1);
+        return RecordPtr{segment,(off_t)offset}.pack();
+    }
+    //the rows of a batch go to one segment with one write
+    vector<streampos> append_rows(const vector<vector<string>>& rows){
+        uint32_t segment=append_segment();
+        off_t before=segment_data(segment).size();
+        vector<streampos> offsets=append_records(segment_file(segment),rows);
+        if(!offsets.empty()&&offsets[0]==streampos(-1)) return offsets;
+        add_live(segment,before,rows.size());
+        for(streampos& offset:offsets) offset=RecordPtr{segment,(off_t)offset}.pack();
+        return offsets;
+    }
+    //bytes of the record ptr points to (length prefix included)
+    size_t record_size(streampos ptr){
+        RecordPtr at=RecordPtr::unpack(ptr);
+        return record_size(segment_data(at.segment),at.offset);
+    }
+    size_t record_size(StorageFile& data,off_t offset){
+        char prefix[sizeof(uint32_t)];
+        const char* len=data.view(offset,sizeof(prefix));
+        if(!len){
+            if(data.read_at(offset,prefix,sizeof(prefix))!=sizeof(prefix)) return 0;
+            len=prefix;
+        }
+        return get_u32(len)+sizeof(uint32_t);
+    }
+    //counts the rows appended to the segment from offset before on as live
+    void add_live(uint32_t segment,off_t before,size_t rows){
+        off_t start=max(before,(off_t)DATA_FILE_HEADER_SIZE);
+        off_t end=segment_data(segment).size();
+        size_t bytes=end>start?end-start:0;
+        segments[segment].live_bytes+=bytes;
+        segments[segment].live_rows+=rows;
+        live_bytes+=bytes;
+        live_rows+=rows;
+    }
+    void remove_live(streampos ptr){
+        Segment& segment=segments[RecordPtr::unpack(ptr).segment];
+        size_t bytes=min(segment.live_bytes,record_size(ptr));
+        segment.live_bytes-=bytes;
+        segment.live_rows-=min(segment.live_rows,(size_t)1);
+        live_bytes-=min(live_bytes,bytes);
+        live_rows-=min(live_rows,(size_t)1);
+    }
+    //the segment files of the table, the last one is the active segment
+    void find_segments(){
+        segments.clear();
+        string prefix=data_file()+"_";
+        if(filesystem::exists("DB_files")){
+            for(const auto& entry:filesystem::directory_iterator("DB_files")){
+                string name=entry.path().stem().string();
+                if(entry.path().extension()!=".txt"||name.size()<=prefix.size()||name.compare(0,prefix.size(),prefix)!=0) continue;
+                if(all_of(name.begin()+prefix.size(),name.end(),::isdigit)) segments[stoul(name.substr(prefix.size()))];
+            }
+        }
+        if(segments.empty()||filesystem::exists(FileManager::path_of(data_file()))) segments[0];
+        active_segment=segments.rbegin()->first;
+    }
+    //one pass over the index when the table is opened, the file of a segment is looked up when the segment changes.
+    //only the files of segments are read (a restore runs this on the pool with them in shared reads), a row in a
+    //segment without a file is not counted
+    void count_live(){
+        live_rows=0;
+        live_bytes=0;
+        for(auto& [number,segment]:segments) segment=Segment();
+        if(text_data_file) return;
+        StorageFile* data=nullptr;
+        uint32_t data_segment=0;
+        for(const auto& [key,ptr]:index_tree->getAllValues()){
+            RecordPtr at=RecordPtr::unpack(ptr);
+            auto it=segments.find(at.segment);
+            if(it==segments.end()) continue;
+            if(!data||at.segment!=data_segment){
+                data=&segment_data(at.segment);
+                data_segment=at.segment;
+            }
+            size_t bytes=record_size(*data,at.offset);
+            Segment& segment=it->second;
+            segment.live_bytes+=bytes;
+            segment.live_rows++;
+            live_bytes+=bytes;
+            live_rows++;
+        }
+    }
+    off_t segment_record_bytes(uint32_t segment){
+        return max(segment_data(segment).size()-(off_t)DATA_FILE_HEADER_SIZE,(off_t)0);
+    }
+    size_t segment_dead_bytes(uint32_t segment){
+        off_t bytes=segment_record_bytes(segment);
+        return bytes>(off_t)segments[segment].live_bytes?bytes-segments[segment].live_bytes:0;
+    }
+    off_t record_bytes(){
+        off_t bytes=0;
+        for(const auto& [number,segment]:segments) bytes+=segment_record_bytes(number);
+        return bytes;
+    }
+    size_t dead_bytes(){ return record_bytes()>(off_t)live_bytes?record_bytes()-live_bytes:0; }
+    double dead_ratio(){ return record_bytes()>0?(double)dead_bytes()/record_bytes():0; }
+    //the segments with a dead share of at least min_ratio, the most garbage per copied byte first.
+    //with compaction_dead_mb of garbage in the table the worst segment is picked whatever its share
+    vector<uint32_t> pick_segments(double min_ratio,size_t max_segments){
+        vector<pair<double,uint32_t>> candidates;
+        for(const auto& [number,segment]:segments){
+            size_t dead=segment_dead_bytes(number);
+            if(dead>0) candidates.push_back({(double)dead/segment_record_bytes(number),number});
+        }
+        sort(candidates.begin(),candidates.end(),greater<pair<double,uint32_t>>());
+        vector<uint32_t> picked;
+        for(const auto& [ratio,number]:candidates){
+            if(picked.size()>=max_segments) break;
+            if(ratio>=min_ratio||(picked.empty()&&dead_bytes()>=(compaction_dead_mb<<20))) picked.push_back(number);
+        }
+        return picked;
+    }
+    //tables with only inserts have no garbage and are never rewritten
+    bool needs_compaction(){ return !pick_segments(compaction_dead_ratio,compaction_max_segments).empty(); }
+    //reads the non key columns of the record at offset, empty if there is no record
+    vector<string> read_record(streampos offset){
+        if(text_data_file) return read_line_from_file(data_file(),offset);
+        vector<string> result;
+        string buf;
+        string_view payload;
+        vector<Value> values;
+        if(offset==streampos(-1)) return result;
+        RecordPtr at=RecordPtr::unpack(offset);
+        if(!read_record_bytes(segment_data(at.segment),at.offset,buf,payload)) return result;
+        if(!decode_record(payload.data(),payload.size(),data_column_types,values)) return result;
+        for(const Value& v:values) result.push_back(v.to_string());
+        return result;
     }
     void add_record(const vector<string>& add_command,const int& command_size){
         if(command_size!=number_of_columns+3){ //INSERT val1 ... valn To table_name 
@@ -73,28 +366,65 @@ public:
             //maybe remove the quatos from inside just for clairty
             else key.push_back(add_command[i+1]); //simple delimiter
         }
+        string encoded_key;
+        int64_t int_key=0;
+        if(int_index) int_key=int_key_of(key[0]);
+        else encoded_key=key_of(key);
         //check if key already exists
-        if(index_tree->search(key).has_value()){
+        if(int_index?int_index->search_key(int_key).has_value():index_tree->search(encoded_key).has_value()){
             throw invalid_argument("Duplicate primary key.");
         }
         //serialize record to a single string
         vector<string> serialized_record;
-        int data_offset=number_of_columns-2*primary_key_size; //
         for(int i=primary_key_size;i<number_of_columns;i++){ //maybe only write the data only without key
-            if(!check_Type(add_command[i+1],column_types[i+data_offset])){ //+1 to skip "INSERT" 
-                throw invalid_argument("Type mismatch in column number "+to_string(i+data_offset+1));
+            if(!check_Type(add_command[i+1],column_types[i])){ //+1 to skip "INSERT" 
+                throw invalid_argument("Type mismatch in column number "+to_string(i+1));
             }
-            if(column_types[i+data_offset]=="S"){
+            if(column_types[i]=="S"){
               serialized_record.push_back(add_command[i+1].substr(1,add_command[i+1].size()-2));
             }
             else serialized_record.push_back(add_command[i+1]);
         }
         //write to file and get offset
-        streampos offset=write_line_to_file(schema_name+"_data", serialized_record);
+        streampos offset=append_row(serialized_record);
         //insert into bplus tree
-        index_tree->insert(key, offset);
+        if(int_index) int_index->insert_key(int_key,offset);
+        else index_tree->insert(encoded_key, offset);
     }
-    void remove_record(const vector<string>& delete_command,const int& command_size){
+    //batch insert, all rows go in or none: the keys are sorted once, checked against the tree in one ordered pass
+    //and the rows are appended with one write
+    void add_records(const vector<vector<string>>& rows){
+        vector<string> keys(rows.size());
+        vector<vector<string>> values(rows.size());
+        for(size_t r=0;r<rows.size();r++){
+            if(rows[r].size()!=(size_t)number_of_columns){
+                throw invalid_argument("Invalid INSERT command (should be INSERT val1 ... valn TO table_name). where n is number of columns in table");
+            }
+            for(int i=0;i<number_of_columns;i++){
+                if(!check_Type(rows[r][i],column_types[i])){
+                    throw invalid_argument("Type mismatch in column number "+to_string(i+1));
+                }
+            }
+            split_row(rows[r],keys[r],&values[r]);
+        }
+        vector<size_t> order(rows.size());
+        for(size_t r=0;r<order.size();r++) order[r]=r;
+        sort(order.begin(),order.end(),[&](size_t a,size_t b){ return keys[a]<keys[b]; });
+        vector<string> sorted_keys;
+        vector<vector<string>> sorted_values;
+        sorted_keys.reserve(order.size());
+        sorted_values.reserve(order.size());
+        for(size_t r:order){
+            if(!sorted_keys.empty()&&sorted_keys.back()==keys[r]) throw invalid_argument("Duplicate primary key.");
+            sorted_keys.push_back(move(keys[r]));
+            sorted_values.push_back(move(values[r]));
+        }
+        if(index_tree->find_first_existing(sorted_keys)>=0) throw invalid_argument("Duplicate primary key.");
+        vector<streampos> offsets=append_rows(sorted_values);
+        for(size_t r=0;r<sorted_keys.size();r++) index_tree->insert(sorted_keys[r],offsets[r]);
+    }
+    //returns the position of the removed row
+    streampos remove_record(const vector<string>& delete_command,const int& command_size){
         if(command_size!=primary_key_size+3){ //DELETE val1 ... valn From table_name 
             throw invalid_argument("invalid DELETE command (should be DELETE val1 ... valn FROM table_name). where n is number of columns in primary key");
         }
@@ -109,281 +439,698 @@ public:
             else key.push_back(delete_command[i+1]);
      //simple delimiter
         }
+        string encoded_key;
+        int64_t int_key=0;
+        if(int_index) int_key=int_key_of(key[0]);
+        else encoded_key=key_of(key);
         //check if key exists
-        optional<streampos> offset=index_tree->search(key);
+        optional<streampos> offset=int_index?int_index->search_key(int_key):index_tree->search(encoded_key);
         if(!offset.has_value()){
             throw invalid_argument("Record with given primary key does not exist.");
         }
+        remove_live(*offset);
         //remove from bplus tree
-        index_tree->remove(key);
-
+        if(int_index) int_index->remove_key(int_key);
+        else index_tree->remove(encoded_key);
+        return *offset;
     }
-    vector<vector<string>> get_all_data(vector<pair<vector<string>,streampos>> idx_tree_values){
-        vector<vector<string>> result; 
-            for(const auto& [key,offset]:idx_tree_values){
-                vector<string> record=read_line_from_file(schema_name+"_data", offset);
-                if(!record.empty()){
-                    record.insert(record.begin(),key.begin(),key.end());
-                    result.push_back(record);
-                }
-        }   
-        return result;
-    } 
-    //maybe work all the cluases at once
-    vector<vector<string>> apply_caluses(const vector<string>& select_command){ //the clauses are at the back
-        //columns name must be on left and cluase must be without any spaces
-        vector<vector<string>> filtered_values;
-        vector<string> commands;
-        bool look_up_index=false;
-        vector<vector<string>> vals_from_index;
-        string op="";
-        string column;
-        string val;
-        int ind=select_command.size()-1;
-        while (select_command[ind]!="WHERE"){
-            string clause=select_command[ind];
-            for(int i=0;i<clause.size()-1;i++){
-                op=clause[i];
-                op+=clause[i+1];
-                if(op==">="||op=="<="||op=="=="||op=="!="){
-                    column=clause.substr(0,i);
-                    val=clause.substr(i+2,clause.size()-(i));
-                    break; //val must be enterd with commas between the values if key bigger then one column
-                }
+    //take back a command that was applied but could not be logged, the rows an insert appended are garbage
+    void undo_insert(const vector<string>& add_command){
+        for(const vector<string>& row:parse_insert_rows(add_command)){
+            string key;
+            split_row(row,key,nullptr);
+            optional<streampos> offset=index_tree->search(key);
+            if(!offset) continue;
+            remove_live(*offset);
+            index_tree->remove(key);
+        }
+    }
+    void undo_delete(const vector<string>& delete_command,streampos offset){
+        string key;
+        split_row(vector<string>(delete_command.begin()+1,delete_command.end()),key,nullptr); //+1 to skip "DELETE"
+        index_tree->insert(key,offset);
+        size_t bytes=record_size(offset);
+        Segment& segment=segments[RecordPtr::unpack(offset).segment];
+        segment.live_bytes+=bytes;
+        segment.live_rows++;
+        live_bytes+=bytes;
+        live_rows++;
+    }
+    //the index key of the key columns (without quotes), the first columns of the key give a prefix of the full keys
+    string key_of(const vector<string>& key_columns) const { return encode_key(key_columns,column_types); }
+    //the key of a table with an int_index, the int key_of would encode
+    static int64_t int_key_of(const string& column){
+        int64_t value=0;
+        auto [ptr,ec]=from_chars(column.data(),column.data()+column.size(),value);
+        if(ec!=errc()||ptr!=column.data()+column.size()) throw invalid_argument("Type mismatch in key column");
+        return value;
+    }
+    //key columns of an index key
+    vector<string> columns_of(const string& key) const {
+        vector<string> columns;
+        if(!decode_key(key,vector<string>(column_types.begin(),column_types.begin()+primary_key_size),columns)){
+            throw invalid_argument("Corrupted key in the index of table "+schema_name);
+        }
+        return columns;
+    }
+    //encoded key and data columns of the values of a row without the quotes (values is null to only get the key)
+    void split_row(const vector<string>& row,string& key,vector<string>* values){
+        int columns=values?number_of_columns:primary_key_size;
+        vector<string> key_columns;
+        for(int i=0;i<columns;i++){
+            const string& token=row[i];
+            string column=column_types[i]=="S"&&token.size()>=2?token.substr(1,token.size()-2):token;
+            if(i<primary_key_size) key_columns.push_back(move(column));
+            else values->push_back(move(column));
+        }
+        key=key_of(key_columns);
+    }
+    //recovery: applies a logged insert (one or more rows) straight to the data file and the index,
+    //a key that is already there gets the new row. the command was checked before it was logged
+    bool apply_insert(const vector<string>& command){
+        vector<vector<string>> rows;
+        vector<string> keys;
+        vector<vector<string>> values;
+        try{
+            rows=parse_insert_rows(command);
+            keys.resize(rows.size());
+            values.resize(rows.size());
+            for(size_t r=0;r<rows.size();r++){
+                if(rows[r].size()!=(size_t)number_of_columns) return false;
+                split_row(rows[r],keys[r],&values[r]);
+            }
+        }
+        catch(const invalid_argument&){
+            return false;
+        }
+        vector<streampos> offsets=append_rows(values);
+        for(size_t r=0;r<rows.size();r++){
+            optional<streampos> old=index_tree->search(keys[r]);
+            if(!old) index_tree->insert(keys[r],offsets[r]);
+            else{
+                remove_live(*old);
+                index_tree->update(keys[r],offsets[r]);
             }
-            
-            if(column=="KEY"){
-                if(look_up_index &&vals_from_index.empty()){ //this means we already looked up the index and we filtered all the values out
-                    return filtered_values;
+        }
+        return true;
+    }
+    //recovery: applies a logged delete, a key that is already gone is fine
+    bool apply_delete(const vector<string>& command){
+        if(command.size()!=(size_t)primary_key_size+3) return false;
+        string key;
+        try{
+            split_row(vector<string>(command.begin()+1,command.end()),key,nullptr); //+1 to skip "DELETE"
+        }
+        catch(const invalid_argument&){
+            return false;
+        }
+        optional<streampos> offset=index_tree->search(key);
+        if(offset){
+            remove_live(*offset);
+            index_tree->remove(key);
+        }
+        return true;
+    }
+    //LOAD: the rows of a CSV/TSV file are sorted by key and appended to the data file in that order.
+    //an empty index is built bottom up from them, into a table that has rows they are inserted in key order
+    //(rebuilding it would cost the whole table on every LOAD). the rows are synced and the tree written before it
+    //returns, a LOAD that fails leaves the table as it was. returns the number of rows loaded
+    size_t load_file(const string& path){
+        vector<string> names(number_of_columns);
+        for(const auto& [name,idx]:column_names) names[idx-2]=name; //idx counts from the first column of CREATE
+        SortedRowReader rows(path,names,column_types,primary_key_size,"DB_files/"+schema_name+"_load_run_");
+        bool bulk=!index_tree->seek(nullopt)->valid();
+        vector<streampos> appended;
+        vector<string> inserted;
+        auto take_back=[&]{
+            if(bulk) for(const string& key:index_tree->getAllKeys()) index_tree->remove(key);
+            else for(const string& key:inserted) index_tree->remove(key);
+            for(streampos offset:appended) remove_live(offset); //the rows of a load that failed are garbage
+        };
+        LoadRow row;
+        try{
+            if(bulk){
+                index_tree->bulk_load([&](string& key,streampos& offset){
+                    if(!rows.next(row)) return false;
+                    key=move(row.key);
+                    offset=append_row(row.values);
+                    appended.push_back(offset);
+                    return true;
+                });
+            }
+            else{
+                while(rows.next(row)){
+                    if(index_tree->search(row.key)) throw invalid_argument("Duplicate primary key.");
+                    streampos offset=append_row(row.values);
+                    appended.push_back(offset);
+                    index_tree->insert(row.key,offset);
+                    inserted.push_back(move(row.key));
                 }
-                vector<string> key;
-                string token;
-                stringstream ss(val);
-                int ind=0;
-                while(getline(ss,token,',')){
-                    if(ind>=primary_key_size) throw invalid_argument("invalid key value");
-                    if(!check_Type(token,column_types[ind])) throw invalid_argument("Type mismatch in column number "+ind);
-                    key.push_back(token);
+            }
+        }
+        catch(...){
+            take_back();
+            throw;
+        }
+        bool synced=true;
+        for(const auto& [number,segment]:segments) synced=file_manager.sync(segment_file(number))&&synced;
+        //after a bulk load every node is new, a full snapshot is cheaper than a delta of all of them
+        if(!synced||!(bulk?index_tree->serialize_Tree():index_tree->checkpoint())){
+            take_back();
+            throw runtime_error("Error writing the loaded rows, nothing was loaded");
+        }
+        return appended.size();
+    }
+    //rows of the table in key order pulled one at a time from an index cursor, the record of a row is read when it is pulled.
+    //nothing else is kept so a scan takes the memory of one row and can stop at any row
+    class RowIterator{
+        Schema& schema;
+        unique_ptr<IndexCursor> cursor;
+        optional<string> upper; //last key of the scan
+        optional<string> end; //first key after the scan (the next part of a parallel scan)
+        set<string> excluded; //keys of the interval that are skipped
+        StorageFile* data=nullptr;
+        uint32_t data_segment=0;
+        string buf;
+        string_view payload;
+        vector<Value> values;
+        bool has_strings; //the records have string columns, their bytes are kept for the views of a batch
+    public:
+        RowIterator(Schema& schema,unique_ptr<IndexCursor> cursor,const optional<string>& upper,const set<string>& excluded={},
+            const optional<string>& end=nullopt):schema(schema),cursor(move(cursor)),upper(upper),end(end),excluded(excluded),
+            has_strings(find(schema.data_column_types.begin(),schema.data_column_types.end(),"S")!=schema.data_column_types.end()){}
+        //fills row with the next row (key columns first), false after the last one. rows whose record cant be read are skipped
+        bool next(vector<string>& row){
+            for(;cursor->valid();cursor->next()){
+                string key=cursor->key();
+                if((upper&&key>*upper)||(end&&key>=*end)) return false;
+                if(!excluded.empty()&&excluded.count(key)) continue;
+                if(!read(key,cursor->value(),row)) continue;
+                cursor->next();
+                return true;
+            }
+            return false;
+        }
+        //fills batch with the next rows (up to SCAN_BATCH_ROWS, batch.init was called with the column types), false after the last one
+        bool next_batch(ColumnBatch& batch){
+            batch.rows=0;
+            for(;cursor->valid()&&batch.rows<SCAN_BATCH_ROWS;cursor->next()){
+                string& key=batch.keys[batch.rows];
+                key=cursor->key();
+                if((upper&&key>*upper)||(end&&key>=*end)) break;
+                if(!excluded.empty()&&excluded.count(key)) continue;
+                if(read(key,cursor->value(),batch,batch.rows)) batch.rows++;
+            }
+            return batch.rows>0;
+        }
+    private:
+        //decodes the row into row r of batch, the strings of the record stay in the batch payload of the row
+        bool read(const string& key,streampos offset,ColumnBatch& batch,size_t r){
+            int key_size=schema.primary_key_size;
+            if(schema.text_data_file){
+                vector<string> record=read_line_from_file(schema.data_file(),offset);
+                if(record.empty()) return false;
+                for(size_t c=0;c<record.size()&&key_size+c<batch.is_int.size();c++) batch.set_text(r,key_size+c,record[c]);
+            }
+            else{
+                RecordPtr at=RecordPtr::unpack(offset);
+                if(!data||at.segment!=data_segment){
+                    data=&schema.segment_data(at.segment);
+                    data_segment=at.segment;
                 }
-                if(!look_up_index){
-                    if(op==">="){
-                        vals_from_index=index_tree->rangeQueryKeys(key,index_tree->get_Max());
-                    }
-                    else if(op=="<="){
-                        vals_from_index=index_tree->rangeQueryKeys(index_tree->get_Min(),key);
-                    }
-                    else if(op=="=="){
-                        optional<streampos> val_from_indx=index_tree->search(key);
-                        if(!val_from_indx.has_value()) return filtered_values;
-                        else{
-                            vals_from_index= {key};
-                        }
-                    }
-                    else if(op=="!="){
-                       vector<vector<string>> dummy =index_tree->getAllKeys();
-                       for(int i=0;i<dummy.size();i++){
-                        if(dummy[i]!=key){
-                            vals_from_index.push_back(dummy[i]);
-                        }
-                       }
-                    }
-                    else{
-                        throw invalid_argument("UNKONWN COMPARSION OPERATOR (SHOULD ONLY BE >= <= != ==)");
-                    }
-                    if (vals_from_index.empty()) return filtered_values;
-                    look_up_index=true;
+                string& bytes=batch.payloads[r];
+                if(!read_record_bytes(*data,at.offset,bytes,payload)) return false;
+                if(has_strings&&payload.data()!=bytes.data()+sizeof(uint32_t)){ //a mapped or pooled page can go before the batch is done
+                    bytes.assign(payload);
+                    payload=bytes;
                 }
-                else{ // that's what left !vals_from_index.empty() && we looked up the index
-                    if(op==">="){
-                        auto it=lower_bound(vals_from_index.begin(),vals_from_index.end(),key);
-                        if(it==vals_from_index.end()) return filtered_values;
-                        else{
-                            vector<vector<string>> dummy;
-                            while(it!=vals_from_index.end()){
-                                dummy.push_back(*it);
-                                ++it;
-                            }
-                            vals_from_index=dummy;
-                        }
-                    }
-                    else if(op=="<="){
-                       auto it = std::upper_bound(vals_from_index.begin(), vals_from_index.end(),key);
-                        if(it == vals_from_index.begin()) return filtered_values;
-                        it=std::prev(it);
-                        vector<vector<string>> dummy;
-                        while(it!=vals_from_index.begin()){
-                            dummy.push_back(*it);
-                            --it;
-                        }
-                        dummy.push_back(*it);
-                        vals_from_index=dummy;
-                    }
-                    else if(op=="=="){
-                        auto it=lower_bound(vals_from_index.begin(),vals_from_index.end(),key);
-                        if(it==vals_from_index.end()) return filtered_values;
-                        else{
-                            if((*it)!=key) return filtered_values;
-                            vals_from_index= {key};
-                        }
-                    }
-                    else if(op=="!="){
-                       vector<vector<string>> dummy;
-                       for(int i=0;i<vals_from_index.size();i++){
-                        if(vals_from_index[i]!=key){
-                            dummy.push_back(vals_from_index[i]);
-                        }
-                       }
-                       vals_from_index=dummy;
-                    }
-                    else{
-                        throw invalid_argument("UNKONWN COMPARSION OPERATOR (SHOULD ONLY BE >= <= != ==)");
-                    }
-                    if (vals_from_index.empty()) return filtered_values;
+                if(!decode_record(payload.data(),payload.size(),schema.data_column_types,values)) return false;
+                for(size_t c=0;c<values.size();c++){
+                    if(values[c].is_int) batch.ints[key_size+c][r]=values[c].int_value;
+                    else batch.strs[key_size+c][r]=values[c].str_value;
                 }
             }
-            else{
-                commands.push_back(clause);
-            }
-            --ind;
-        }
-        try {
-            vector<vector<string>> dummy;
-            if (vals_from_index.empty()){
-                dummy=get_all_data(index_tree->getAllValues());
-            }
-            else {
-                dummy=get_all_data(index_tree->rangeQuery(vals_from_index.front(),vals_from_index.back()));
-            }
-            for(const auto& clause:commands){
-                for(int i=0;i<clause.size();i++){
-                    op=clause[i];
-                    op+=clause[i+1];
-                    if(op==">="||op=="<="||op=="=="||op=="!="){
-                        column=clause.substr(0,i);
-                        val=clause.substr(i+2,clause.size()-(i));
-                        break; //val must be enterd with commas between the values if key bigger then one column
-                    }  
-                }
-                int idx=column_names.at(column);
-                if(!check_Type(val,column_types[idx])) throw invalid_argument("value given doesnt match column "+column+" type");
-                    if(op==">="){
-                            for(const vector<string>& v : dummy){
-                            if(v[idx]>=val) filtered_values.push_back(v);
-                            }
-                        }
-                        else if(op=="<="){
-                            for(const vector<string>& v : dummy){
-                                if(v[idx]<=val) filtered_values.push_back(v);
-                            }
-                        }
-                        else if(op=="=="){
-                            for(const vector<string>& v : dummy){
-                                if(v[idx]==val) filtered_values.push_back(v);
-                            }
-                        }
-                        else if(op=="!="){
-                            for(const vector<string>& v : dummy){
-                                if(v[idx]!=val) filtered_values.push_back(v);
-                            }
-                        }
-                        else{
-                            throw invalid_argument("UNKONWN COMPARSION OPERATOR (SHOULD ONLY BE >= <= != ==)");
-                        }
-            if(filtered_values.empty()) return filtered_values;
-            dummy=filtered_values;
-            filtered_values.clear();
-            }
-            return dummy;
-        }
-        catch(const out_of_range& e){
-           throw invalid_argument("the column "+column+" doesnt exist");
-        }
-    }  
-    vector<string> select_records(const vector<string>& select_command,const int& command_size){
-        //need to add priority to KEY clauses
-        auto it=find(select_command.begin(),select_command.end(),"WHERE");
-        vector<vector<string>> all_values;
-        if(it!=select_command.end()){
-            ++it;
-            if(it==select_command.end()) throw invalid_argument("there is WHERE word but no clauses");
-            all_values=apply_caluses(select_command);
+            int64_t int_key;
+            if(cursor->int_key(int_key)) batch.ints[0][r]=int_key;
+            else if(!batch.set_key(r,key,key_size)) throw invalid_argument("Corrupted key in the index of table "+schema.schema_name);
+            return true;
+        }
+        bool read(const string& key,streampos offset,vector<string>& row){
+            if(schema.text_data_file){
+                vector<string> record=read_line_from_file(schema.data_file(),offset);
+                if(record.empty()) return false;
+                row=schema.columns_of(key);
+                row.insert(row.end(),record.begin(),record.end());
+                return true;
+            }
+            RecordPtr at=RecordPtr::unpack(offset);
+            if(!data||at.segment!=data_segment){
+                data=&schema.segment_data(at.segment);
+                data_segment=at.segment;
+            }
+            if(!read_record_bytes(*data,at.offset,buf,payload)) return false;
+            if(!decode_record(payload.data(),payload.size(),schema.data_column_types,values)) return false;
+            row=schema.columns_of(key);
+            for(const Value& v:values) row.push_back(v.to_string());
+            return true;
         }
-        else {
-         all_values=get_all_data(index_tree->getAllValues());
+    };
+    //the rows with keys from lower to upper (encoded keys, the whole table without them)
+    RowIterator rows(const optional<string>& lower=nullopt,const optional<string>& upper=nullopt){
+        return RowIterator(*this,index_tree->seek(lower),upper);
+    }
+    RowIterator rows(const KeyRange& range){
+        return RowIterator(*this,index_tree->seek(range.lower),range.upper,range.excluded);
+    }
+    //the encoded key of a KEY clause value (val1,val2,...,valk, a prefix of the key columns)
+    string key_of_clause(const string& val){
+        vector<string> key_columns;
+        string token;
+        stringstream ss(val);
+        int ind=0;
+        while(getline(ss,token,',')){
+            if(ind>=primary_key_size) throw invalid_argument("invalid key value");
+            if(!check_Type(token,column_types[ind])) throw invalid_argument("Type mismatch in column number "+to_string(ind+1));
+            if(column_types[ind]=="S") token=token.substr(1,token.size()-2);
+            key_columns.push_back(token);
+            ind++;
         }
-        vector<string> result;
-        if(select_command[1]=="*"){
-            //select all columns
-            for(const vector<string>& v:all_values){
-                string str="";
-                for(int i=0;i<v.size();++i){
-                    if(column_types[i]=="S") str+='\"'+v[i]+'\"'+" ";
-                    else str+=v[i]+" ";
-
+        return key_of(key_columns);
+    }
+    //compiles one node of a WHERE (and its children) into filter, returns its index
+    int compile_node(const WhereExpr& expr,RowFilter& filter){
+        RowFilter::Node node;
+        node.kind=expr.kind;
+        if(expr.kind!=WhereExpr::CLAUSE){
+            for(const auto& child:expr.children) node.children.push_back(compile_node(*child,filter));
+        }
+        else if(expr.column=="KEY"){
+            node.op=to_cmp_op(expr.op);
+            node.str_value=key_of_clause(expr.value);
+        }
+        else{
+            auto found=column_names.find(expr.column);
+            if(found==column_names.end()) throw invalid_argument("the column "+expr.column+" doesnt exist");
+            node.column=found->second-2; //column_names counts from the first column of CREATE
+            if(!check_Type(expr.value,column_types[node.column])) throw invalid_argument("value given doesnt match column "+expr.column+" type");
+            node.op=to_cmp_op(expr.op);
+            node.is_int=column_types[node.column]=="I";
+            if(node.is_int) from_chars(expr.value.data(),expr.value.data()+expr.value.size(),node.int_value);
+            else node.str_value=expr.value.substr(1,expr.value.size()-2);
+        }
+        filter.nodes.push_back(move(node));
+        return filter.nodes.size()-1;
+    }
+    //parses the WHERE of a select once: the KEY clauses ANDed at the top are merged into range (the part of the index that
+    //is walked), everything else is compiled into the filter the rows are checked with
+    RowFilter compile_where(const vector<string>& select_command,KeyRange& range){
+        RowFilter filter;
+        filter.key_types.assign(column_types.begin(),column_types.begin()+primary_key_size);
+        auto where=find(select_command.begin(),select_command.end(),"WHERE");
+        if(where==select_command.end()) return filter;
+        unique_ptr<WhereExpr> expr=WhereParser(vector<string>(where+1,select_command.end())).parse();
+        vector<const WhereExpr*> conjuncts,pending={expr.get()};
+        while(!pending.empty()){
+            const WhereExpr* e=pending.back();
+            pending.pop_back();
+            if(e->kind==WhereExpr::AND) for(auto it=e->children.rbegin();it!=e->children.rend();++it) pending.push_back(it->get());
+            else conjuncts.push_back(e);
+        }
+        RowFilter::Node all;
+        all.kind=WhereExpr::AND;
+        for(const WhereExpr* e:conjuncts){
+            if(e->kind==WhereExpr::CLAUSE&&e->column=="KEY"){
+                range.intersect(e->op,key_of_clause(e->value));
+            }
+            else all.children.push_back(compile_node(*e,filter));
+        }
+        if(all.children.size()==1) filter.root=all.children[0];
+        else if(all.children.size()>1){
+            filter.nodes.push_back(move(all));
+            filter.root=filter.nodes.size()-1;
+        }
+        return filter;
+    }
+    //the rows a select reads: the KEY clauses pick the part of the index that is walked, the other clauses filter the rows
+    //a batch at a time (decoded by column, see Batch.h) and only the rows that pass are turned into strings.
+    //visit gets every row that passes and returns false to stop the scan. a range of more than one part is scanned
+    //by tasks of the pool, visit is still called on this thread, in key order unless ordered is false
+    void scan(const vector<string>& select_command,const function<bool(const vector<string>&)>& visit,bool ordered=true){
+        KeyRange range;
+        RowFilter filter=compile_where(select_command,range);
+        if(range.empty()) return;
+        vector<string> splits;
+        if(scan_threads>1&&!text_data_file) splits=index_tree->split_keys(range.lower,range.upper,max<size_t>(1,scan_morsel_rows/fanout));
+        if(splits.empty()){
+            scan_part(range,nullopt,nullopt,filter,[&](vector<string>& row){ return visit(row); });
+            return;
+        }
+        parallel_scan(range,splits,filter,visit,ordered);
+    }
+    //the rows of range from lower (the start of range without it) to before end that pass filter
+    void scan_part(const KeyRange& range,const optional<string>& lower,const optional<string>& end,const RowFilter& filter,
+                   const function<bool(vector<string>&)>& visit){
+        RowIterator it(*this,index_tree->seek(lower?lower:range.lower),range.upper,range.excluded,end);
+        ColumnBatch batch;
+        batch.init(column_types);
+        vector<uint32_t> sel(SCAN_BATCH_ROWS);
+        vector<string> row;
+        while(it.next_batch(batch)){
+            size_t passed=select_batch(filter,batch,sel.data());
+            for(size_t i=0;i<passed;i++){
+                batch.row(sel[i],row);
+                if(!visit(row)) return;
+            }
+        }
+    }
+    //every part between the split keys is a task of the pool that keeps the rows of its part that pass, this thread hands
+    //them to visit part by part (in key order, or as they are done) and runs tasks of the pool while it waits. at most two
+    //parts per scan thread are submitted and not yet visited, so the memory of the scan doesnt grow with the table
+    void parallel_scan(const KeyRange& range,const vector<string>& splits,const RowFilter& filter,
+                       const function<bool(const vector<string>&)>& visit,bool ordered){
+        struct Part{
+            vector<vector<string>> rows;
+            bool done=false;
+        };
+        size_t parts_count=splits.size()+1,window=2*min(scan_threads,parts_count);
+        vector<Part> parts(parts_count);
+        deque<size_t> finished; //parts done and not visited yet, in the order they were done (unordered scans)
+        vector<future<void>> tasks;
+        mutex m;
+        atomic<bool> stop=false; //read by the tasks between rows
+        auto run_part=[&](size_t p){
+            vector<vector<string>> rows;
+            exception_ptr error;
+            try{
+                scan_part(range,p==0?nullopt:optional<string>(splits[p-1]),p<splits.size()?optional<string>(splits[p]):nullopt,filter,
+                          [&](vector<string>& row){
+                              rows.push_back(move(row));
+                              return !stop;
+                          });
+            }
+            catch(...){
+                error=current_exception();
+            }
+            {
+                lock_guard<mutex> guard(m);
+                parts[p].rows=move(rows);
+                parts[p].done=true;
+                if(!ordered) finished.push_back(p);
+                if(error) stop=true;
+            }
+            if(error) rethrow_exception(error);
+        };
+        for(const auto& [number,segment]:segments) segment_data(number).begin_shared_reads();
+        size_t submitted=0,visited=0;
+        exception_ptr error;
+        try{
+            while(visited<parts_count){
+                for(;submitted<parts_count&&submitted<visited+window;submitted++){
+                    tasks.push_back(task_pool().submit([&run_part,p=submitted]{ run_part(p); }));
                 }
-                str.pop_back();
-                result.push_back(str);
-            }
-            return result;
-        } 
-        else {
-            vector<int> col_indices;
-            for(auto it2 = select_command.begin()+1;it2!=it;it2++){
-                try{
-                    int idx=column_names.at(*it2);
-                    col_indices.push_back(idx);
+                //the pool wakes this thread when a part is done (its task finished), and it runs parts while it waits
+                task_pool().wait_until([&]{
+                    lock_guard<mutex> guard(m);
+                    return stop||(ordered?parts[visited].done:!finished.empty());
+                });
+                size_t p;
+                {
+                    lock_guard<mutex> guard(m);
+                    if(stop) break;
+                    if(ordered) p=visited;
+                    else{
+                        p=finished.front();
+                        finished.pop_front();
+                    }
                 }
-                catch(const out_of_range& e){
-                    throw invalid_argument("the column "+*it2+" doesnt exist");
+                bool go_on=true;
+                for(const vector<string>& row:parts[p].rows){
+                    if(!(go_on=visit(row))) break;
                 }
+                vector<vector<string>>().swap(parts[p].rows);
+                visited++;
+                if(!go_on) break;
             }
-            //retrieve all records and filter columns
-            for(const vector<string>& v:all_values){
-                string record="";
-                for(int idx:col_indices){
-                    if(column_types[idx]=="S") record+='\"'+v[idx]+'\"'+" ";
-                    record+=v[idx]+" ";
-                }
-                record.pop_back();
-                result.push_back(record);
+        }
+        catch(...){
+            error=current_exception();
+        }
+        stop=true;
+        for(future<void>& task:tasks) task_pool().wait(task);
+        for(const auto& [number,segment]:segments) segment_data(number).end_shared_reads();
+        for(future<void>& task:tasks){
+            try{
+                task.get();
+            }
+            catch(...){
+                if(!error) error=current_exception();
             }
         }
-        return result;
+        if(error) rethrow_exception(error);
+    }
+    //runs a select and hands every result line to emit in key order, stops when emit returns false
+    void select_rows(const vector<string>& select_command,const function<bool(const string&)>& emit){
+        auto it=find(select_command.begin(),select_command.end(),"WHERE");
+        if(it!=select_command.end()&&it+1==select_command.end()) throw invalid_argument("there is WHERE word but no clauses");
+        vector<int> col_indices;
+        if(select_command[1]=="*"){
+            for(int i=0;i<number_of_columns;i++) col_indices.push_back(i);
+        }
+        else{
+            auto from=find(select_command.begin(),select_command.end(),"FROM");
+            for(auto it2=select_command.begin()+1;it2!=from;it2++){
+                auto found=column_names.find(*it2);
+                if(found==column_names.end()) throw invalid_argument("the column "+*it2+" doesnt exist");
+                col_indices.push_back(found->second-2);
+            }
+        }
+        string line;
+        scan(select_command,[&](const vector<string>& v){
+            line.clear();
+            for(int idx:col_indices){
+                if(column_types[idx]=="S") line+='\"'+v[idx]+'\"'+" ";
+                else line+=v[idx]+" ";
+            }
+            line.pop_back();
+            return emit(line);
+        });
     }
+    //rewrites the live records into a new data file, text data files are upgraded to the binary format on the way
     void GC(){
         if(!filesystem::exists("DB_files/"+schema_name+"_data.txt")) return;
-        vector<pair<vector<string>,streampos>> all_values=index_tree->getAllValues();
+        vector<pair<string,streampos>> all_values=index_tree->getAllValues();
         vector<streampos> offsets;
+        file_manager.remove(schema_name+"_data_temp"); //leftover of a GC that didnt finish
         for (const auto& [key,offset]:all_values){
-            vector<string> record=read_line_from_file(schema_name+"_data", offset);
-            streampos new_offset=write_line_to_file(schema_name+"_data_temp", record);
+            vector<string> record=read_record(offset);
+            streampos new_offset=append_record(schema_name+"_data_temp", record);
             offsets.push_back(new_offset);
         }
         index_tree->GC_with_values(offsets);
         //replace old data file with new compacted file
-        if(remove(("DB_files/"+schema_name+"_data.txt").c_str())!=0){
-            cerr<<"Error deleting old data file during GC."<<endl;
-        }
-        if(rename(("DB_files/"+schema_name+"_data_temp.txt").c_str(),("DB_files/"+schema_name+"_data.txt").c_str())!=0){
+        if(!file_manager.sync(schema_name+"_data_temp")||!file_manager.replace(schema_name+"_data_temp",schema_name+"_data")){
             cerr<<"Error renaming temp data file during GC."<<endl;
         }
+        text_data_file=false;
+        count_live();
+        compactions++;
         //serialize the tree to update offsets
         index_tree->serialize_Tree();
     }
-void desrialize_Schema(){
-    index_tree->deserialize_Tree();
-}
+    //background compaction of the worst segments: the chosen segments are sealed and the tree is walked in chunks,
+    //the rows that live in them are appended again to the active segment and their keys pointed there.
+    //every step runs under the DB lock, the segment files are only removed after a checkpoint of the tree
+    struct Compaction{
+        vector<uint32_t> segments; //being emptied
+        optional<string> last_key; //where the next step continues
+        size_t rows_moved=0;
+        size_t bytes_copied=0;
+    };
+    Compaction begin_compaction(double min_ratio,size_t max_segments){
+        Compaction compaction;
+        compaction.segments=pick_segments(min_ratio,max_segments);
+        if(find(compaction.segments.begin(),compaction.segments.end(),active_segment)!=compaction.segments.end()){
+            active_segment=segments.rbegin()->first+1; //the copies cant go to a segment being emptied
+            segments[active_segment];
+        }
+        return compaction;
+    }
+    //copies the live rows of the next chunk of keys, false once every key was visited
+    bool compaction_step(Compaction& compaction,size_t max_rows){
+        vector<pair<string,streampos>> chunk=index_tree->valuesAfter(compaction.last_key,max_rows);
+        if(chunk.empty()) return false;
+        for(const auto& [key,offset]:chunk){
+            uint32_t segment=RecordPtr::unpack(offset).segment;
+            if(find(compaction.segments.begin(),compaction.segments.end(),segment)==compaction.segments.end()) continue;
+            streampos copy=append_row(read_record(offset));
+            remove_live(offset);
+            index_tree->update(key,copy);
+            compaction.rows_moved++;
+            compaction.bytes_copied+=record_size(copy);
+        }
+        compaction.last_key=chunk.back().first;
+        return true;
+    }
+    bool compaction_rewrote_most(const Compaction& compaction){ return compaction.rows_moved*2>=live_rows; }
+    //after the checkpoint that made the tree point to the copies
+    void drop_segments(const Compaction& compaction){
+        for(uint32_t segment:compaction.segments){
+            if(segments[segment].live_rows>0||segment==active_segment) continue;
+            file_manager.remove(segment_file(segment));
+            segments.erase(segment);
+        }
+        compactions++;
+    }
+    //indexes of older versions: the key columns as strings (ints compare like strings there) and, for a table
+    //keyed by one int, the encoded keys as strings. the newest one is loaded once and the index built bottom up
+    //from its keys (encoded and sorted). true if the index was built here. the old trees are read with the fanout of the
+    //table (DEFAULT_FANOUT for the tables of versions that didnt store one), like the index built from them
+    bool upgrade_index(){
+        BPlusTree<vector<string>,streampos> old_index(fanout/2,schema_name);
+        BPlusTree<string,streampos> string_index(fanout/2,schema_name+"_index");
+        bool encoded=string_index.file_name!=index_tree->file_name()&&string_index.has_files();
+        if(!encoded&&!old_index.has_files()) return false;
+        bool upgraded=!index_tree->has_files();
+        if(upgraded){
+            vector<pair<string,streampos>> values;
+            if(encoded){
+                string_index.deserialize_Tree();
+                values=string_index.getAllValues();
+            }
+            else{
+                old_index.deserialize_Tree();
+                for(const auto& [key,offset]:old_index.getAllValues()) values.push_back({key_of(key),offset});
+                sort(values.begin(),values.end());
+            }
+            size_t next=0;
+            index_tree->bulk_load([&](string& key,streampos& offset){
+                if(next==values.size()) return false;
+                key=values[next].first;
+                offset=values[next++].second;
+                return true;
+            });
+            index_tree->serialize_Tree();
+        }
+        old_index.remove_files(); //also the leftovers of an upgrade that crashed after the new snapshot
+        if(encoded) string_index.remove_files();
+        return upgraded;
+    }
+    //true when the index is in the binary snapshots of this version and there is no older index to upgrade,
+    //loading it then only reads its own files so the indexes of many tables are loaded at once
+    bool index_loads_alone(){
+        if(!index_tree->has_binary_files()) return false;
+        BPlusTree<vector<string>,streampos> old_index(fanout/2,schema_name);
+        BPlusTree<string,streampos> string_index(fanout/2,schema_name+"_index");
+        return !old_index.has_files()&&!(string_index.file_name!=index_tree->file_name()&&string_index.has_files());
+    }
+    void load_index(){
+        if(!upgrade_index()) index_tree->deserialize_Tree();
+    }
+    //finds the data files, a text data file of an older version is upgraded here
+    void open_data(){
+        find_segments();
+        if(filesystem::exists(FileManager::path_of(data_file()))&&!is_binary_data_file(file_manager.get(data_file()))){
+            text_data_file=true; //written by an older version, upgrade once on open
+            GC();
+        }
+    }
 };
 
 
 
 
+struct RecoveryStats{
+    size_t replayed=0; //log records applied
+    size_t skipped=0; //log records already covered by the checkpoint
+    double ms=0;
+};
+
 class DB{
 public:
     unordered_map<string, Schema> schemas;
     int number_of_ops; //map of table name to row count
+    WAL wal; //log of the inserts/deletes since the last GC
+    RecoveryStats recovery; //of the last deserialize_DB
+    recursive_mutex lock; //the commands and the steps of the background compaction run one at a time
+    thread compactor; //compacts the data files in the background, started on the first request
+    condition_variable_any wake_compactor;
+    deque<pair<string,bool>> pending_compactions; //tables waiting for the compactor, true to rewrite every segment with garbage
+    string compacting; //table the compactor is working on, empty when idle
+    bool stop_compactor=false;
     DB():number_of_ops(0){}
+    DB(const DB&)=delete;
+    DB& operator=(const DB&)=delete;
+    ~DB(){ stop_compaction(); }
+    //moves the live rows out of the worst segments of the table in chunks, the lock is released between chunks
+    //so commands keep running. the copying is throttled to compaction_mb_per_s. a compaction that is stopped
+    //leaves the segments it didnt finish, their rows are still there for the tree of the last checkpoint
+    void compact_table(unique_lock<recursive_mutex>& guard,const string& table_name,bool every_segment){
+        auto it=schemas.find(table_name);
+        if(it==schemas.end()||it->second.text_data_file) return; //text files are upgraded by GC
+        Schema::Compaction compaction=every_segment?it->second.begin_compaction(0,SIZE_MAX):
+            it->second.begin_compaction(compaction_dead_ratio,compaction_max_segments);
+        if(compaction.segments.empty()) return;
+        while(true){
+            it=schemas.find(table_name);
+            if(stop_compactor||it==schemas.end()) return;
+            size_t copied=compaction.bytes_copied;
+            if(!it->second.compaction_step(compaction,compaction_chunk_rows)) break;
+            copied=compaction.bytes_copied-copied;
+            auto pause=compaction_mb_per_s>0?chrono::duration<double>(copied/(compaction_mb_per_s*(1<<20))):chrono::duration<double>(0);
+            //waiting releases the lock, the commands waiting for it go first
+            wake_compactor.wait_for(guard,pause,[&]{ return stop_compactor; });
+        }
+        //moving most rows dirtied most leaves, a new snapshot then loads faster than the snapshot and a delta as big.
+        //the copies are synced before a snapshot points to them
+        if(it->second.compaction_rewrote_most(compaction)&&file_manager.sync_all()) it->second.index_tree->serialize_Tree();
+        //the tree on disk points to the copies once the checkpoint is done, the old segments stay until then
+        if(checkpoint()) it->second.drop_segments(compaction);
+    }
+    void compactor_loop(){
+        unique_lock<recursive_mutex> guard(lock);
+        while(true){
+            wake_compactor.wait(guard,[&]{ return stop_compactor||!pending_compactions.empty(); });
+            if(stop_compactor) return;
+            auto [table_name,every_segment]=pending_compactions.front();
+            pending_compactions.pop_front();
+            compacting=table_name;
+            compact_table(guard,table_name,every_segment);
+            compacting.clear();
+            wake_compactor.notify_all();
+        }
+    }
+    //every_segment rewrites every segment with garbage, else only the ones over compaction_dead_ratio
+    void request_compaction(const string& table_name,bool every_segment=false){
+        lock_guard<recursive_mutex> guard(lock);
+        auto it=find_if(pending_compactions.begin(),pending_compactions.end(),[&](const auto& p){ return p.first==table_name; });
+        if(it!=pending_compactions.end()){
+            it->second=it->second||every_segment;
+            return;
+        }
+        if(compacting==table_name&&!every_segment) return;
+        pending_compactions.push_back({table_name,every_segment});
+        if(!compactor.joinable()) compactor=thread(&DB::compactor_loop,this);
+        wake_compactor.notify_all();
+    }
+    //must not be called while holding the lock
+    void wait_for_compactions(){
+        unique_lock<recursive_mutex> guard(lock);
+        wake_compactor.wait(guard,[&]{ return pending_compactions.empty()&&compacting.empty(); });
+    }
+    //a compaction that didnt finish is dropped, its rows are still in the old data file
+    void stop_compaction(){
+        {
+            lock_guard<recursive_mutex> guard(lock);
+            stop_compactor=true;
+        }
+        wake_compactor.notify_all();
+        if(compactor.joinable()) compactor.join();
+        lock_guard<recursive_mutex> guard(lock);
+        stop_compactor=false;
+        pending_compactions.clear();
+    }
     void create_table(const vector<string>& create_command){
+        lock_guard<recursive_mutex> guard(lock);
         int command_size=create_command.size();
         if(command_size<5){ //needed CREATE table_name col1:type1 ... Key col1 ... at least 5 tokens
             throw invalid_argument("Invalid create command");
@@ -391,8 +1138,7 @@ public:
         if(schemas.find(create_command[1])!=schemas.end()){
             throw invalid_argument("Table "+create_command[1]+" already exists.");
         }
-        Schema schema(create_command,command_size,create_command[1]);
-        schemas[create_command[1]]=schema;
+        schemas.emplace(create_command[1],Schema(create_command,command_size,create_command[1]));
         ofstream serilaize_file("DB_files/DB.txt",ios::app);
         for(int i=0;i<command_size-1;i++){
             serilaize_file<<create_command[i]<<" ";
@@ -400,15 +1146,13 @@ public:
         serilaize_file<<create_command[command_size-1]<<endl;
         serilaize_file.close();
     }
-    void write_to_journal(const vector<string>& command){ //used for inserts and deletions only
-        ofstream journal_file("DB_files/DB_journal.txt",ios::app);
-        for(int i=0;i<command.size()-1;i++){
-            journal_file<<command[i]<<" ";
-        }
-        journal_file<<command[command.size()-1]<<endl;
-        journal_file.close();
+    void write_to_journal(const vector<string>& command){ //used for inserts and deletions only, throws if the log failed
+        wal.append(command);
     }
-    void add_record(const vector<string>& add_command){ //INSERT val1 val2 ... To table_name
+    //INSERT and DELETE are logged first and then count towards the next checkpoint. false if the checkpoint they
+    //started failed (the command itself is in the log and the next command tries the checkpoint again)
+    bool add_record(const vector<string>& add_command){ //INSERT val1 val2 ... To table_name
+        lock_guard<recursive_mutex> guard(lock);
         int command_size=add_command.size();
         if(find(add_command.begin(),add_command.end(),"TO")==add_command.end()){ //needed INSERT val1 ... To table_name at least 4 tokens
             throw invalid_argument("missing TO in insert command");
@@ -420,14 +1164,26 @@ public:
         if(schemas.find(table_name)==schemas.end()){
             throw invalid_argument("Table "+table_name+" does not exist.");
         }
-        schemas[table_name].add_record(add_command,command_size);
-        number_of_ops++;
-        if(number_of_ops>NUM_OF_OPS_FOR_GLOB_GC) GC();
-        else{         
-                write_to_journal(add_command);
+        size_t rows=1;
+        if(command_size>1&&!add_command[1].empty()&&add_command[1][0]=='('){ //INSERT (row) (row) ... TO table_name
+            if(add_command[command_size-2]!="TO") throw invalid_argument("missing TO in insert command");
+            vector<vector<string>> parsed=parse_insert_rows(add_command);
+            schemas[table_name].add_records(parsed);
+            rows=parsed.size();
         }
+        else schemas[table_name].add_record(add_command,command_size);
+        //the whole command is one log record, however many rows it has
+        try{
+            write_to_journal(add_command);
+        }
+        catch(const runtime_error&){ //not durable, so not done
+            schemas[table_name].undo_insert(add_command);
+            throw;
+        }
+        return count_ops(table_name,rows);
     }
-    void remove_record(const vector<string>& delete_command){
+    bool remove_record(const vector<string>& delete_command){
+        lock_guard<recursive_mutex> guard(lock);
         int command_size=delete_command.size();
         if(find(delete_command.begin(),delete_command.end(),"FROM")==delete_command.end()){ //needed DELETE val1 ... From table_name at least 4 tokens
             throw invalid_argument("missing FROM in delete command");
@@ -439,14 +1195,39 @@ public:
         if(schemas.find(table_name)==schemas.end()){
             throw invalid_argument("Table "+table_name+" does not exist.");
         }
-        schemas[table_name].remove_record(delete_command,command_size);
-        number_of_ops++;
-        if(number_of_ops>=NUM_OF_OPS_FOR_GLOB_GC) GC(); //intiate global GC
-        else{
-                write_to_journal(delete_command);
+        streampos removed=schemas[table_name].remove_record(delete_command,command_size);
+        try{
+            write_to_journal(delete_command);
         }
+        catch(const runtime_error&){ //not durable, so not done
+            schemas[table_name].undo_delete(delete_command,removed);
+            throw;
+        }
+        return count_ops(table_name,1);
     }
-    vector<string> select_records(const vector<string>& select_command){
+    //counts logged changes, checks the garbage of the table and starts a global checkpoint every NUM_OF_OPS_FOR_GLOB_GC
+    bool count_ops(const string& table_name,size_t ops){
+        number_of_ops+=ops;
+        schemas[table_name].ops_since_check+=ops;
+        check_garbage(table_name);
+        return number_of_ops<NUM_OF_OPS_FOR_GLOB_GC||checkpoint();
+    }
+    size_t load_table(const vector<string>& load_command){ //LOAD table_name FROM file
+        lock_guard<recursive_mutex> guard(lock);
+        if(load_command.size()!=4||load_command[2]!="FROM"){
+            throw invalid_argument("Invalid LOAD command (should be LOAD table_name FROM file)");
+        }
+        if(schemas.find(load_command[1])==schemas.end()){
+            throw invalid_argument("Table "+load_command[1]+" does not exist.");
+        }
+        //not logged: a checkpoint empties the log first, so no older command is ever replayed over the loaded rows,
+        //and load_file writes them to disk before it returns
+        if(!checkpoint()) throw runtime_error("Error writing checkpoint, nothing was loaded");
+        return schemas[load_command[1]].load_file(load_command[3]);
+    }
+    //hands the result lines to emit as the rows are read, emit returns false to stop
+    void select_rows(const vector<string>& select_command,const function<bool(const string&)>& emit){
+        lock_guard<recursive_mutex> guard(lock);
          int command_size=select_command.size();
          auto it=find(select_command.begin(),select_command.end(),"FROM");
         if(command_size<4||find(select_command.begin(),select_command.end(),"FROM")==select_command.end()){ //needed SELECT column FROM table_name at least 4 tokens
@@ -461,20 +1242,115 @@ public:
         if(schemas.find(table_name)==schemas.end()){
             throw invalid_argument("Table "+table_name+" does not exist.");
         }
-        return schemas[table_name].select_records(select_command,command_size);
+        schemas[table_name].select_rows(select_command,emit);
     }
+    vector<string> select_records(const vector<string>& select_command){
+        vector<string> result;
+        select_rows(select_command,[&](const string& line){
+            result.push_back(line);
+            return true;
+        });
+        return result;
+    }
+    //compacts every table and waits for it, commands from other threads keep running meanwhile
     void GC(){
+        {
+            lock_guard<recursive_mutex> guard(lock);
+            for(auto& [table_name,schema]:schemas) request_compaction(table_name,true);
+        }
+        wait_for_compactions();
+        lock_guard<recursive_mutex> guard(lock);
+        for(auto& [table_name,schema]:schemas){
+            if(schema.text_data_file) schema.GC(); //upgrades the file to the binary format
+        }
+        checkpoint();
+    }
+    //every NUM_OF_OPS_FOR_GC changes of a table its garbage is checked, only a table over the threshold is compacted
+    void check_garbage(const string& table_name){
+        Schema& schema=schemas[table_name];
+        if(schema.ops_since_check<NUM_OF_OPS_FOR_GC) return;
+        schema.ops_since_check=0;
+        if(schema.needs_compaction()) request_compaction(table_name);
+    }
+    //one line per table: rows, live and dead bytes of the data file and the bytes of the index files
+    vector<string> stats(){
+        lock_guard<recursive_mutex> guard(lock);
+        vector<string> lines;
+        for(auto& [table_name,schema]:schemas){
+            stringstream line;
+            line<<fixed<<setprecision(1)<<table_name<<": rows="<<schema.live_rows<<" data="<<schema.record_bytes()
+                <<" live="<<schema.live_bytes<<" dead="<<schema.dead_bytes()<<" ("<<schema.dead_ratio()*100<<"% dead)"
+                <<" index snapshot="<<schema.index_tree->snapshot_bytes()<<" delta="<<schema.index_tree->delta_bytes()
+                <<" fanout="<<schema.fanout<<" height="<<schema.index_tree->height()<<" index memory="<<schema.index_tree->memory_bytes()
+                <<" segments="<<schema.segments.size()<<" compactions="<<schema.compactions;
+            lines.push_back(line.str());
+        }
+        sort(lines.begin(),lines.end());
+        return lines;
+    }
+    //makes everything applied so far durable without compacting the data files,
+    //the trees only write the nodes changed since their last checkpoint.
+    //every step is synced before the next one: data files, trees, checkpoint lsn and only then the log is dropped.
+    //false if a step failed, the log is kept then so nothing is lost
+    bool checkpoint(){
+        lock_guard<recursive_mutex> guard(lock);
+        if(!file_manager.sync_all()){ //the trees point into these files
+            cerr<<"Error writing data files, checkpoint skipped"<<endl;
+            return false;
+        }
+        bool trees_written=true;
         for(auto& [table_name,schema]:schemas){
-                schema.GC(); 
+            trees_written=schema.index_tree->checkpoint()&&trees_written;
         }
+        if(!trees_written) return false;
         number_of_ops=0;
-        if(filesystem::exists("DB_files/DB_journal.txt")){
+        //the checkpoint is written before the log is dropped, a crash in between only leaves records replay skips
+        if(!write_checkpoint(wal.last_lsn())) return false;
+        wal.reset();
+        if(filesystem::exists("DB_files/DB_journal.txt")){ //text journal of older versions
             filesystem::remove("DB_files/DB_journal.txt");
         }
+        return true;
+    }
+    //the temp file is synced before it is renamed over the checkpoint file and the directory after it,
+    //so the new lsn is on disk before the log is dropped. false if it may not be
+    static bool write_checkpoint(uint64_t lsn){
+        bool written;
+        {
+            ofstream temp("DB_files/DB_checkpoint_temp.txt",ios::trunc);
+            temp<<lsn<<endl;
+            written=temp.good();
+        }
+        written=written&&sync_path("DB_files/DB_checkpoint_temp.txt");
+        error_code ec;
+        if(written) filesystem::rename("DB_files/DB_checkpoint_temp.txt",CHECKPOINT_FILE,ec);
+        if(!written||ec||!sync_path("DB_files")){
+            cerr<<"Error writing checkpoint"<<endl;
+            return false;
+        }
+        return true;
+    }
+    static uint64_t read_checkpoint(){
+        uint64_t lsn=0;
+        ifstream file(CHECKPOINT_FILE);
+        file>>lsn;
+        return lsn;
+    }
+    //applies a logged command without the checks and the logging of add_record/remove_record
+    void replay(const vector<string>& command){
+        auto it=schemas.find(command.back());
+        bool applied=false;
+        if(it!=schemas.end()){
+            applied=command[0]=="INSERT"?it->second.apply_insert(command):it->second.apply_delete(command);
+        }
+        if(!applied) cerr<<"Skipping bad log record for table "<<command.back()<<endl;
+        recovery.replayed++;
     }
     void deserialize_DB(){
+        lock_guard<recursive_mutex> guard(lock);
         ifstream file("DB_files/DB.txt");
         string command;
+        vector<Schema*> opened;
         while(getline(file,command)){
             stringstream ss(command);
             string token;
@@ -482,12 +1358,34 @@ public:
             while(getline(ss,token,' ')){
                 create_command.push_back(token);
             }
-            Schema schema(create_command,create_command.size(),create_command[1]);
-            schemas[create_command[1]]=schema;
-            schema.desrialize_Schema();
+            Schema& schema=schemas.insert_or_assign(create_command[1],Schema(create_command,create_command.size(),create_command[1])).first->second;
+            if(find(opened.begin(),opened.end(),&schema)==opened.end()) opened.push_back(&schema);
         }
         file.close();
-        if(filesystem::exists("DB_files/DB_journal.txt")){
+        //a table is opened with load_index, open_data and count_live. the steps that only touch the files of their table
+        //run on the pool for all the tables at once: loading index snapshots and counting the live rows
+        vector<char> alone(opened.size());
+        for(size_t i=0;i<opened.size();i++) alone[i]=opened[i]->index_loads_alone();
+        task_pool().parallel_for(opened.size(),[&](size_t i){
+            if(alone[i]) opened[i]->index_tree->deserialize_Tree();
+        });
+        for(size_t i=0;i<opened.size();i++){
+            if(!alone[i]) opened[i]->load_index();
+            opened[i]->open_data();
+            for(const auto& [number,segment]:opened[i]->segments) opened[i]->segment_data(number).begin_shared_reads();
+        }
+        task_pool().parallel_for(opened.size(),[&](size_t i){ opened[i]->count_live(); });
+        for(Schema* schema:opened){
+            for(const auto& [number,segment]:schema->segments) schema->segment_data(number).end_shared_reads();
+        }
+        //only the records after the checkpoint are applied, restart time depends on the tail of the log
+        auto start=chrono::steady_clock::now();
+        recovery=RecoveryStats();
+        uint64_t checkpoint_lsn=read_checkpoint(),last_lsn=checkpoint_lsn;
+        size_t valid_end;
+        vector<WAL::Record> logged=WAL::read_all(&valid_end);
+        bool legacy=false; //journal written by an older version, records without lsn
+        if(filesystem::exists("DB_files/DB_journal.txt")){ //text journal of older versions, older than any log record
             ifstream journal("DB_files/DB_journal.txt");
             string command;
             while(getline(journal,command)){
@@ -497,20 +1395,30 @@ public:
                 while(getline(ss,token,' ')){
                     command_vec.push_back(token);
                 }
-                if(command_vec[0]=="INSERT"){ //can only be insert and delete
-                    add_record(command_vec);
-                }
-                else{
-                    remove_record(command_vec);
-                }
+                if(!command_vec.empty()) replay(command_vec);
             }
-            journal.close();
-            filesystem::remove("DB_files/DB_journal.txt");
+            legacy=true;
+        }
+        for(const WAL::Record& record:logged){
+            last_lsn=max(last_lsn,record.lsn);
+            if(record.lsn!=0&&record.lsn<=checkpoint_lsn){
+                recovery.skipped++;
+                continue;
+            }
+            if(record.lsn==0) legacy=true;
+            if(!record.command.empty()) replay(record.command);
         }
+        wal.resume(valid_end,last_lsn); //the replayed records stay in the log until the next checkpoint
+        number_of_ops=recovery.replayed;
+        if(legacy) checkpoint(); //fold the old journal into a checkpoint so the log only holds records with lsns
+        recovery.ms=chrono::duration<double,milli>(chrono::steady_clock::now()-start).count();
     }
     void clear(){
+        stop_compaction();
+        lock_guard<recursive_mutex> guard(lock);
         schemas.clear();
         number_of_ops=0;
+        wal.close();
     }
 
 };
@@ -0,0 +1,259 @@
+#ifndef FILE_MANAGER_H
+#define FILE_MANAGER_H
+#define READ_CHUNK_SIZE 512 //bytes copied per step when looking for end of line
+#define MIN_MAP_SIZE (1<<20) //first mapping of a file, grows by doubling so appends rarely need a remap
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <filesystem>
+#include "BufferPool.h"
+using namespace std;
+//the storage layer keeps one open descriptor per file in DB_files and counts every syscall it makes (io_stats)
+inline bool mmap_reads=true; //serve reads of the flushed part from a mapping of the file instead of the buffer pool
+
+//fsync of a file written through a stream, or of a directory so the renames and removes in it survive a crash
+inline bool sync_path(const string& path){
+    int fd=::open(path.c_str(),O_RDONLY);
+    io_stats.opens++;
+    if(fd<0) return false;
+    bool synced=::fsync(fd)==0;
+    ::close(fd);
+    io_stats.closes++;
+    return synced;
+}
+
+//one append only file made of PAGE_SIZE pages that live in the buffer pool.
+//appends fill the tail page (dirty until flushed or evicted), reads copy from the cached pages
+class StorageFile{
+    DiskFile disk;
+    string path;
+    off_t file_size; //bytes appended so far, the ones after disk.disk_size are only in dirty pages
+    char* map_addr; //read only mapping of the file, may be bigger than the file
+    size_t map_size;
+    bool shared_reads=false; //reads come from the mapping or pread only, so many threads can read at once
+    void unmap(){
+        if(map_addr){
+            munmap(map_addr,map_size);
+            io_stats.maps++;
+            map_addr=nullptr;
+            map_size=0;
+        }
+    }
+    //makes sure the mapping covers the first end bytes of the file
+    bool map_to(size_t end){
+        if(map_addr&&end<=map_size) return true;
+        size_t new_size=map_size?map_size:MIN_MAP_SIZE;
+        while(new_size<end) new_size*=2;
+        unmap();
+        void* addr=mmap(nullptr,new_size,PROT_READ,MAP_SHARED,disk.fd,0);
+        io_stats.maps++;
+        if(addr==MAP_FAILED) return false;
+        map_addr=(char*)addr;
+        map_size=new_size;
+        return true;
+    }
+public:
+    StorageFile(const string& path):path(path),file_size(0),map_addr(nullptr),map_size(0){
+        //no O_APPEND, pages are written back at their own offset
+        disk.fd=::open(path.c_str(),O_RDWR|O_CREAT,0644);
+        io_stats.opens++;
+        if(disk.fd<0){
+            cerr<<"Error opening file: "<<path<<endl;
+            return;
+        }
+        struct stat st;
+        if(fstat(disk.fd,&st)==0) disk.disk_size=file_size=st.st_size;
+    }
+    StorageFile(const StorageFile&)=delete;
+    StorageFile& operator=(const StorageFile&)=delete;
+    ~StorageFile(){
+        buffer_pool.drop_file(disk);
+        unmap();
+        if(disk.fd>=0){
+            ::close(disk.fd);
+            io_stats.closes++;
+        }
+    }
+    bool is_open() const { return disk.fd>=0; }
+    off_t size() const { return file_size; }
+    //returns the offset the data was written at
+    off_t append(const char* data,size_t len){
+        off_t offset=file_size;
+        while(len>0){
+            size_t in_page=file_size%PAGE_SIZE;
+            size_t n=min(len,PAGE_SIZE-in_page);
+            BufferPool::Frame* page=buffer_pool.fetch(disk,file_size/PAGE_SIZE);
+            memcpy(page->data+in_page,data,n);
+            page->valid=in_page+n;
+            buffer_pool.unpin(page,true);
+            data+=n;
+            len-=n;
+            file_size+=n;
+        }
+        return offset;
+    }
+    off_t append(const string& data){ return append(data.data(),data.size()); }
+    //writes the dirty pages of this file, false if a write failed
+    bool flush(){ return buffer_pool.flush_file(disk); }
+    //flushes the file and waits until the disk has it
+    bool sync(){ return flush()&&::fsync(disk.fd)==0; }
+    //until end_shared_reads view/view_line/read_at can run on many threads at once: the file is flushed and mapped
+    //here (on one thread) and the reads dont touch the buffer pool. nothing may be appended meanwhile
+    void begin_shared_reads(){
+        flush();
+        if(mmap_reads&&disk.disk_size>0) map_to(disk.disk_size);
+        shared_reads=true;
+    }
+    void end_shared_reads(){ shared_reads=false; }
+    //pointer to len bytes at offset without copying them, from the mapping or a cached page.
+    //nullptr if the range is not there or crosses a page that is not flushed yet.
+    //only valid until the next append/read of any file (the file may be remapped, the page evicted)
+    const char* view(off_t offset,size_t len){
+        if(offset<0||offset+(off_t)len>file_size) return nullptr;
+        if(mmap_reads&&offset+(off_t)len<=disk.disk_size){
+            if(!map_to(disk.disk_size)) return nullptr;
+            return map_addr+offset;
+        }
+        if(shared_reads) return nullptr;
+        size_t in_page=offset%PAGE_SIZE;
+        if(in_page+len>PAGE_SIZE) return nullptr;
+        BufferPool::Frame* page=buffer_pool.fetch(disk,offset/PAGE_SIZE);
+        buffer_pool.unpin(page,false);
+        return in_page+len<=page->valid?page->data+in_page:nullptr;
+    }
+    //the line at offset (without '\n') as a view, false if it cant be viewed in place
+    bool view_line(off_t offset,string_view& line){
+        if(offset<0||offset>=file_size) return false;
+        const char* start;
+        size_t avail;
+        if(mmap_reads&&offset<disk.disk_size){
+            if(!map_to(disk.disk_size)) return false;
+            start=map_addr+offset;
+            avail=disk.disk_size-offset;
+        }
+        else{
+            if(shared_reads) return false;
+            size_t in_page=offset%PAGE_SIZE;
+            BufferPool::Frame* page=buffer_pool.fetch(disk,offset/PAGE_SIZE);
+            buffer_pool.unpin(page,false);
+            if(in_page>=page->valid) return false;
+            start=page->data+in_page;
+            avail=page->valid-in_page;
+        }
+        const char* end=(const char*)memchr(start,'\n',avail);
+        if(!end) return false;
+        line=string_view(start,end-start);
+        return true;
+    }
+    //copies up to len bytes at offset out of the cached pages
+    size_t read_at(off_t offset,char* out,size_t len){
+        if(shared_reads){
+            if(offset>=file_size) return 0;
+            ssize_t n=::pread(disk.fd,out,min(len,(size_t)(file_size-offset)),offset);
+            io_stats.reads++;
+            return n>0?n:0;
+        }
+        size_t done=0;
+        while(done<len&&offset+(off_t)done<file_size){
+            off_t pos=offset+done;
+            size_t in_page=pos%PAGE_SIZE;
+            BufferPool::Frame* page=buffer_pool.fetch(disk,pos/PAGE_SIZE);
+            size_t n=0;
+            if(in_page<page->valid) n=min(len-done,page->valid-in_page);
+            memcpy(out+done,page->data+in_page,n);
+            buffer_pool.unpin(page,false);
+            if(n==0) break;
+            done+=n;
+        }
+        return done;
+    }
+    //reads from offset until '\n' (not included), false if nothing is there
+    bool read_line(off_t offset,string& line){
+        line.clear();
+        char chunk[READ_CHUNK_SIZE];
+        while(true){
+            size_t n=read_at(offset,chunk,READ_CHUNK_SIZE);
+            if(n==0) return !line.empty();
+            char* end=(char*)memchr(chunk,'\n',n);
+            if(end){
+                line.append(chunk,end-chunk);
+                return true;
+            }
+            line.append(chunk,n);
+            offset+=n;
+        }
+    }
+};
+
+//owns the open files of DB_files, files are named like the rest of the code names them (without dir and .txt)
+class FileManager{
+    unordered_map<string,unique_ptr<StorageFile>> files;
+    mutex open_lock; //of files, get runs on pool threads too (restore, parallel scans) and may open a file there
+public:
+    static string path_of(const string& name){ return "DB_files/"+name+".txt"; }
+    StorageFile& get(const string& name){
+        lock_guard<mutex> guard(open_lock);
+        auto it=files.find(name);
+        if(it==files.end()){
+            it=files.emplace(name,make_unique<StorageFile>(path_of(name))).first;
+        }
+        return *it->second;
+    }
+    bool flush(const string& name){
+        lock_guard<mutex> guard(open_lock);
+        auto it=files.find(name);
+        return it==files.end()||it->second->flush();
+    }
+    bool sync(const string& name){
+        lock_guard<mutex> guard(open_lock);
+        auto it=files.find(name);
+        return it==files.end()||it->second->sync();
+    }
+    void close(const string& name){
+        lock_guard<mutex> guard(open_lock);
+        files.erase(name);
+    }
+    //false if a file could not be written, the others are still flushed
+    bool flush_all(){
+        lock_guard<mutex> guard(open_lock);
+        bool ok=true;
+        for(auto& [name,file]:files) ok=file->flush()&&ok;
+        return ok;
+    }
+    bool sync_all(){
+        lock_guard<mutex> guard(open_lock);
+        bool ok=true;
+        for(auto& [name,file]:files) ok=file->sync()&&ok;
+        return ok;
+    }
+    void close_all(){
+        lock_guard<mutex> guard(open_lock);
+        files.clear();
+    }
+    //the file is closed and removed under the lock, so no get can open it in between
+    void remove(const string& name){
+        lock_guard<mutex> guard(open_lock);
+        files.erase(name);
+        filesystem::remove(path_of(name));
+    }
+    //moves the (flushed) content of from over to, used by GC to swap in a compacted file
+    bool replace(const string& from,const string& to){
+        lock_guard<mutex> guard(open_lock);
+        files.erase(from);
+        files.erase(to);
+        error_code ec;
+        filesystem::rename(path_of(from),path_of(to),ec);
+        return !ec;
+    }
+};
+inline FileManager file_manager;
+#endif
@@ -0,0 +1,61 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+#define CACHE_LINE 64 //nodes and their key arrays start on a cache line
+#define NODE_SLAB_BYTES (256<<10) //memory a node pool takes from the heap at a time
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+using namespace std;
+//fixed size blocks for the nodes of one tree. slabs of NODE_SLAB_BYTES are cut into blocks on cache lines,
+//a freed block goes on a free list (the link is kept in the block) and is handed out next,
+//so allocate and free are O(1) and the nodes of a tree sit next to each other. release gives back every slab at once
+class NodePool{
+    size_t block_size;
+    size_t slab_bytes;
+    vector<char*> slabs;
+    char* free_list=nullptr; //each free block starts with the pointer to the next one
+    char* next_block=nullptr; //blocks of the newest slab that were never handed out
+    char* slab_end=nullptr;
+    size_t blocks_used=0;
+public:
+    NodePool(size_t bytes){
+        block_size=(max(bytes,sizeof(char*))+CACHE_LINE-1)/CACHE_LINE*CACHE_LINE;
+        slab_bytes=max((size_t)NODE_SLAB_BYTES/block_size,(size_t)1)*block_size;
+    }
+    NodePool(const NodePool&)=delete;
+    NodePool& operator=(const NodePool&)=delete;
+    ~NodePool(){ release(); }
+    void* allocate(){
+        blocks_used++;
+        if(free_list){
+            char* block=free_list;
+            free_list=*(char**)block;
+            return block;
+        }
+        if(next_block==slab_end){
+            next_block=(char*)::operator new(slab_bytes,align_val_t(CACHE_LINE));
+            slab_end=next_block+slab_bytes;
+            slabs.push_back(next_block);
+        }
+        char* block=next_block;
+        next_block+=block_size;
+        return block;
+    }
+    void deallocate(void* block){
+        *(char**)block=free_list;
+        free_list=(char*)block;
+        blocks_used--;
+    }
+    //frees every block, whatever was in them is not destroyed
+    void release(){
+        for(char* slab:slabs) ::operator delete(slab,align_val_t(CACHE_LINE));
+        slabs.clear();
+        free_list=next_block=slab_end=nullptr;
+        blocks_used=0;
+    }
+    size_t reserved_bytes() const { return slabs.size()*slab_bytes; }
+    size_t used_bytes() const { return blocks_used*block_size; }
+    size_t blocks() const { return blocks_used; }
+};
+#endif
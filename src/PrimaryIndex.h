@@ -0,0 +1,194 @@
+#ifndef PRIMARY_INDEX_H
+#define PRIMARY_INDEX_H
+#include <memory>
+#include "BPlusTree.h"
+#include "Record.h"
+using namespace std;
+//the index of a table, keys go in and out encoded (encode_key) and values are the record pointers.
+//the tree behind it is picked by the key columns when the table is created: a key of one int column
+//is kept as int64 (nodes are plain arrays searched with node_bound, no string per key), any other key as the encoded string.
+//values are int64 in both, the snapshots write them as int64 like streampos so the files of the string tree didnt change
+//forward cursor over an index in key order (PrimaryIndex::seek), the key is encoded and built only when it is read
+class IndexCursor{
+public:
+    virtual ~IndexCursor(){}
+    virtual bool valid() const=0;
+    virtual void next()=0;
+    virtual string key() const=0;
+    virtual streampos value() const=0;
+    //the key of a tree of one int key column as the int, without encoding it. false for the other trees
+    virtual bool int_key(int64_t&) const { return false; }
+};
+
+class PrimaryIndex{
+public:
+    virtual ~PrimaryIndex(){}
+    virtual void insert(const string& key,streampos value)=0;
+    virtual optional<streampos> search(const string& key)=0;
+    virtual bool update(const string& key,streampos value)=0;
+    virtual int find_first_existing(const vector<string>& keys)=0;
+    virtual void remove(const string& key)=0;
+    virtual vector<string> rangeQueryKeys(const string& lower,const string& upper)=0;
+    virtual vector<pair<string,streampos>> rangeQuery(const string& lower,const string& upper)=0;
+    virtual vector<string> getAllKeys()=0;
+    virtual vector<pair<string,streampos>> getAllValues()=0;
+    virtual vector<pair<string,streampos>> valuesAfter(const optional<string>& after,size_t limit)=0;
+    virtual unique_ptr<IndexCursor> seek(const optional<string>& key)=0; //at the first key not less than key, the smallest without it
+    virtual vector<string> split_keys(const optional<string>& lower,const optional<string>& upper,size_t leaves)=0; //BPlusTree::leaf_splits
+    virtual string get_Max()=0;
+    virtual string get_Min()=0;
+    virtual void GC_with_values(const vector<streampos>& values)=0;
+    virtual void bulk_load(const function<bool(string&,streampos&)>& next)=0;
+    virtual bool serialize_Tree()=0;
+    virtual bool checkpoint()=0;
+    virtual void deserialize_Tree()=0;
+    virtual bool has_files()=0;
+    virtual bool has_binary_files()=0; //snapshots of this version, loading them reads no other file
+    virtual void remove_files()=0;
+    virtual string file_name() const=0;
+    virtual string snapshot_path() const=0; //of the current generation
+    virtual size_t snapshot_bytes() const=0;
+    virtual size_t delta_bytes() const=0;
+    virtual size_t dirty_count() const=0;
+    virtual size_t height() const=0;
+    virtual size_t memory_bytes()=0;
+};
+
+//K is the key type of the tree: string (the encoded key as is) or int64_t (a key of one int column)
+template<typename K>
+class TreeIndex:public PrimaryIndex{
+public:
+    BPlusTree<K,int64_t> tree;
+    class Cursor:public IndexCursor{
+        typename BPlusTree<K,int64_t>::Cursor cursor;
+    public:
+        Cursor(const typename BPlusTree<K,int64_t>::Cursor& cursor):cursor(cursor){}
+        bool valid() const override { return cursor.valid(); }
+        void next() override { cursor.next(); }
+        string key() const override { return from_tree(cursor.key()); }
+        streampos value() const override { return streampos(cursor.value()); }
+        bool int_key(int64_t& key) const override {
+            if constexpr (is_same_v<K,int64_t>){
+                key=cursor.key();
+                return true;
+            }
+            else return false;
+        }
+    };
+    TreeIndex(int degree,const string& name):tree(degree,name){}
+    //an encoded int key is the int big endian with the sign bit flipped, a shorter one (no columns) is padded with zeros
+    static K to_tree(const string& key){
+        if constexpr (is_same_v<K,int64_t>){
+            uint64_t v=0;
+            for(size_t i=0;i<sizeof(uint64_t);i++) v=(v<<8)|(i<key.size()?(uint8_t)key[i]:0);
+            return (int64_t)(v^(1ULL<<63));
+        }
+        else return key;
+    }
+    static string from_tree(const K& key){
+        if constexpr (is_same_v<K,int64_t>){
+            string out(sizeof(uint64_t),'\0');
+            uint64_t v=(uint64_t)key^(1ULL<<63);
+            for(int i=sizeof(uint64_t)-1;i>=0;i--,v>>=8) out[i]=(char)v;
+            return out;
+        }
+        else return key;
+    }
+    static vector<pair<string,streampos>> from_tree(vector<pair<K,int64_t>>&& values){
+        vector<pair<string,streampos>> out;
+        out.reserve(values.size());
+        for(auto& [key,value]:values) out.emplace_back(from_tree(key),streampos(value));
+        return out;
+    }
+    //the calls with a key of the tree type, Schema makes them on an int64 tree (Schema::int_index) without encoding
+    //the key or a virtual call
+    void insert_key(const K& key,streampos value){ tree.insert(key,value); }
+    optional<streampos> search_key(const K& key){
+        optional<int64_t> value=tree.search(key);
+        if(!value) return nullopt;
+        return streampos(*value);
+    }
+    void remove_key(const K& key){ tree.remove(key); }
+    void insert(const string& key,streampos value) override { insert_key(to_tree(key),value); }
+    optional<streampos> search(const string& key) override { return search_key(to_tree(key)); }
+    bool update(const string& key,streampos value) override { return tree.update(to_tree(key),value); }
+    int find_first_existing(const vector<string>& keys) override {
+        if constexpr (is_same_v<K,string>) return tree.find_first_existing(keys);
+        else{
+            vector<K> tree_keys;
+            tree_keys.reserve(keys.size());
+            for(const string& key:keys) tree_keys.push_back(to_tree(key));
+            return tree.find_first_existing(tree_keys);
+        }
+    }
+    void remove(const string& key) override { remove_key(to_tree(key)); }
+    vector<string> rangeQueryKeys(const string& lower,const string& upper) override {
+        if constexpr (is_same_v<K,string>) return tree.rangeQueryKeys(lower,upper);
+        else{
+            vector<string> out;
+            for(const K& key:tree.rangeQueryKeys(to_tree(lower),to_tree(upper))) out.push_back(from_tree(key));
+            return out;
+        }
+    }
+    vector<pair<string,streampos>> rangeQuery(const string& lower,const string& upper) override {
+        return from_tree(tree.rangeQuery(to_tree(lower),to_tree(upper)));
+    }
+    vector<string> getAllKeys() override {
+        if constexpr (is_same_v<K,string>) return tree.getAllKeys();
+        else{
+            vector<string> out;
+            for(const K& key:tree.getAllKeys()) out.push_back(from_tree(key));
+            return out;
+        }
+    }
+    vector<pair<string,streampos>> getAllValues() override { return from_tree(tree.getAllValues()); }
+    vector<pair<string,streampos>> valuesAfter(const optional<string>& after,size_t limit) override {
+        return from_tree(tree.valuesAfter(after?optional<K>(to_tree(*after)):nullopt,limit));
+    }
+    unique_ptr<IndexCursor> seek(const optional<string>& key) override {
+        return make_unique<Cursor>(key?tree.seek(to_tree(*key)):tree.first());
+    }
+    vector<string> split_keys(const optional<string>& lower,const optional<string>& upper,size_t leaves) override {
+        vector<string> result;
+        for(const K& key:tree.leaf_splits(lower?optional<K>(to_tree(*lower)):nullopt,upper?optional<K>(to_tree(*upper)):nullopt,leaves)){
+            result.push_back(from_tree(key));
+        }
+        return result;
+    }
+    string get_Max() override { return from_tree(tree.get_Max()); }
+    string get_Min() override { return from_tree(tree.get_Min()); }
+    void GC_with_values(const vector<streampos>& values) override {
+        tree.GC_with_values(vector<int64_t>(values.begin(),values.end()));
+    }
+    void bulk_load(const function<bool(string&,streampos&)>& next) override {
+        string key;
+        streampos value;
+        tree.bulk_load([&](K& tree_key,int64_t& tree_value){
+            if(!next(key,value)) return false;
+            if constexpr (is_same_v<K,string>) tree_key=move(key);
+            else tree_key=to_tree(key);
+            tree_value=value;
+            return true;
+        });
+    }
+    bool serialize_Tree() override { return tree.serialize_Tree(); }
+    bool checkpoint() override { return tree.checkpoint(); }
+    void deserialize_Tree() override { tree.deserialize_Tree(); }
+    bool has_files() override { return tree.has_files(); }
+    bool has_binary_files() override { return tree.has_binary_files(); }
+    void remove_files() override { tree.remove_files(); }
+    string file_name() const override { return tree.file_name; }
+    string snapshot_path() const override { return tree.snapshot_path(tree.generation); }
+    size_t snapshot_bytes() const override { return tree.snapshot_bytes; }
+    size_t delta_bytes() const override { return tree.delta_bytes; }
+    size_t dirty_count() const override { return tree.dirty_count(); }
+    size_t height() const override { return tree.height(); }
+    size_t memory_bytes() override { return tree.memory_bytes(); }
+};
+
+//the index of a new table, key_types are the types of the key columns
+unique_ptr<PrimaryIndex> make_primary_index(const vector<string>& key_types,const string& table_name,int degree){
+    if(key_types.size()==1&&key_types[0]=="I") return make_unique<TreeIndex<int64_t>>(degree,table_name+"_int_index");
+    return make_unique<TreeIndex<string>>(degree,table_name+"_index");
+}
+#endif
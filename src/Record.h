@@ -0,0 +1,213 @@
+#ifndef RECORD_H
+#define RECORD_H
+#define RECORD_FORMAT_VERSION 1
+#define RECORD_READ_AHEAD 256 //bytes read with the length prefix, most rows fit so one pread per row
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include "FileManager.h"
+using namespace std;
+//binary row format of the <table>_data file:
+//file header: "TSQLDATA" + u32 version
+//record: u32 payload length, then for every non key column in order
+//    I -> int64 (8 bytes little endian)
+//    S -> u32 length + the bytes (no quotes, may contain any byte)
+static const char DATA_FILE_MAGIC[8]={'T','S','Q','L','D','A','T','A'};
+static const size_t DATA_FILE_HEADER_SIZE=sizeof(DATA_FILE_MAGIC)+sizeof(uint32_t);
+
+#define SEGMENT_OFFSET_BITS 40 //offsets in a segment file are below 1 TB
+//where a row is: its segment of the data file and the offset in that segment's file.
+//the index keeps it packed in one streampos (segment<<SEGMENT_OFFSET_BITS|offset),
+//so the offsets of older versions (one data file) are segment 0 without converting anything
+struct RecordPtr{
+    uint32_t segment;
+    off_t offset;
+    static RecordPtr unpack(streampos pos){
+        long long v=pos;
+        return {(uint32_t)(v>>SEGMENT_OFFSET_BITS),(off_t)(v&((1LL<<SEGMENT_OFFSET_BITS)-1))};
+    }
+    streampos pack() const { return streampos(((long long)segment<<SEGMENT_OFFSET_BITS)|offset); }
+};
+
+//a decoded column, str_value points into the buffer the record was decoded from
+struct Value{
+    bool is_int;
+    int64_t int_value;
+    string_view str_value;
+    string to_string() const { return is_int?std::to_string(int_value):string(str_value); }
+};
+
+inline void put_u32(string& out,uint32_t v){ out.append((const char*)&v,sizeof(v)); }
+inline void put_i64(string& out,int64_t v){ out.append((const char*)&v,sizeof(v)); }
+inline uint32_t get_u32(const char* p){ uint32_t v; memcpy(&v,p,sizeof(v)); return v; }
+inline int64_t get_i64(const char* p){ int64_t v; memcpy(&v,p,sizeof(v)); return v; }
+
+//checksum of the log records and the tree snapshots (crc32, slicing by 8: 8 table lookups per 8 bytes)
+uint32_t crc32(const char* data,size_t len){
+    static uint32_t table[8][256];
+    static bool init=[]{
+        for(uint32_t i=0;i<256;i++){
+            uint32_t c=i;
+            for(int k=0;k<8;k++) c=(c&1)?0xEDB88320u^(c>>1):c>>1;
+            table[0][i]=c;
+        }
+        for(uint32_t i=0;i<256;i++){
+            for(int t=1;t<8;t++) table[t][i]=(table[t-1][i]>>8)^table[0][table[t-1][i]&0xFF];
+        }
+        return true;
+    }();
+    (void)init;
+    uint32_t crc=0xFFFFFFFFu;
+    const uint8_t* p=(const uint8_t*)data;
+    for(;len>=8;len-=8,p+=8){
+        uint32_t low=get_u32((const char*)p)^crc,high=get_u32((const char*)p+4);
+        crc=table[7][low&0xFF]^table[6][(low>>8)&0xFF]^table[5][(low>>16)&0xFF]^table[4][low>>24]^
+            table[3][high&0xFF]^table[2][(high>>8)&0xFF]^table[1][(high>>16)&0xFF]^table[0][high>>24];
+    }
+    for(;len>0;len--,p++) crc=table[0][(crc^*p)&0xFF]^(crc>>8);
+    return crc^0xFFFFFFFFu;
+}
+
+//primary keys in the index are one byte string that sorts like the key columns with memcmp
+//(std::string compares its bytes unsigned, so the tree compares keys with one memcmp):
+//    I -> int64 big endian with the sign bit flipped, so negative numbers come first
+//    S -> the bytes with 0x00 escaped as 0x00 0xFF, then 0x00 0x01 (a string sorts before the ones it is a prefix of)
+//the columns are given without quotes like the record values. a key of the first k columns is a prefix of the full keys
+void append_key_column(string& out,string_view column,const string& type){
+    if(type=="I"){
+        long long value=0;
+        auto [ptr,ec]=from_chars(column.data(),column.data()+column.size(),value);
+        if(ec!=errc()||ptr!=column.data()+column.size()) throw invalid_argument("Type mismatch in key column");
+        uint64_t v=(uint64_t)value^(1ULL<<63);
+        for(int shift=56;shift>=0;shift-=8) out+=(char)(v>>shift);
+        return;
+    }
+    for(char c:column){
+        out+=c;
+        if(c=='\0') out+=(char)0xFF;
+    }
+    out+='\0';
+    out+=(char)1;
+}
+string encode_key(const vector<string>& columns,const vector<string>& types){
+    string out;
+    for(size_t i=0;i<columns.size();i++) append_key_column(out,columns[i],types[i]);
+    return out;
+}
+//the column of an encoded key at p (p is moved past it) into int_value or str_value, false if the bytes are not a column of the type
+bool next_key_column(string_view key,size_t& p,bool is_int,int64_t& int_value,string& str_value){
+    if(is_int){
+        if(p+sizeof(uint64_t)>key.size()) return false;
+        uint64_t v=0;
+        for(size_t i=0;i<sizeof(uint64_t);i++) v=(v<<8)|(uint8_t)key[p+i];
+        p+=sizeof(uint64_t);
+        int_value=(int64_t)(v^(1ULL<<63));
+        return true;
+    }
+    str_value.clear();
+    while(true){
+        if(p+1>=key.size()) return false;
+        if(key[p]!='\0') str_value+=key[p++];
+        else if((uint8_t)key[p+1]==0xFF){
+            str_value+='\0';
+            p+=2;
+        }
+        else if(key[p+1]==1){
+            p+=2;
+            return true;
+        }
+        else return false;
+    }
+}
+//the column values of an encoded key (ints in decimal), false if the bytes are not a key of these types
+bool decode_key(string_view key,const vector<string>& types,vector<string>& columns){
+    size_t p=0;
+    for(const string& type:types){
+        int64_t int_value=0;
+        string column;
+        if(!next_key_column(key,p,type=="I",int_value,column)) return false;
+        columns.push_back(type=="I"?std::to_string((long long)int_value):move(column));
+    }
+    return p==key.size();
+}
+
+string data_file_header(){
+    string header(DATA_FILE_MAGIC,sizeof(DATA_FILE_MAGIC));
+    put_u32(header,RECORD_FORMAT_VERSION);
+    return header;
+}
+//values are the column values already stripped from quotes, types are "I" or "S"
+string encode_record(const vector<string>& values,const vector<string>& types){
+    string out;
+    put_u32(out,0); //patched when size is known
+    for(size_t i=0;i<values.size();i++){
+        if(types[i]=="I") put_i64(out,stoll(values[i]));
+        else{
+            put_u32(out,values[i].size());
+            out+=values[i];
+        }
+    }
+    uint32_t len=out.size()-sizeof(uint32_t);
+    memcpy(out.data(),&len,sizeof(len));
+    return out;
+}
+//decodes a payload (without the length prefix) into out, no copies of the strings are made
+bool decode_record(const char* data,size_t len,const vector<string>& types,vector<Value>& out){
+    out.clear();
+    size_t pos=0;
+    for(const string& type:types){
+        Value v;
+        if(type=="I"){
+            if(pos+sizeof(int64_t)>len) return false;
+            v.is_int=true;
+            v.int_value=get_i64(data+pos);
+            pos+=sizeof(int64_t);
+        }
+        else{
+            if(pos+sizeof(uint32_t)>len) return false;
+            uint32_t str_len=get_u32(data+pos);
+            pos+=sizeof(uint32_t);
+            if(pos+str_len>len) return false;
+            v.is_int=false;
+            v.int_value=0;
+            v.str_value=string_view(data+pos,str_len);
+            pos+=str_len;
+        }
+        out.push_back(v);
+    }
+    return true;
+}
+//reads the record at offset, payload is set to the bytes after the length prefix
+//with mmap_reads the payload points straight into the mapping and buf is not touched
+bool read_record_bytes(StorageFile& file,off_t offset,string& buf,string_view& payload){
+    if(const char* prefix=file.view(offset,sizeof(uint32_t))){
+        uint32_t len=get_u32(prefix);
+        if(const char* data=file.view(offset,len+sizeof(uint32_t))){
+            payload=string_view(data+sizeof(uint32_t),len);
+            return true;
+        }
+    }
+    if(buf.size()<RECORD_READ_AHEAD) buf.resize(RECORD_READ_AHEAD);
+    size_t n=file.read_at(offset,buf.data(),RECORD_READ_AHEAD);
+    if(n<sizeof(uint32_t)) return false;
+    uint32_t len=get_u32(buf.data());
+    size_t total=len+sizeof(uint32_t);
+    if(n<total){
+        buf.resize(total);
+        if(file.read_at(offset+n,buf.data()+n,total-n)!=total-n) return false;
+    }
+    payload=string_view(buf.data()+sizeof(uint32_t),len);
+    return true;
+}
+//true if the file starts with the binary header (an empty file has no format yet)
+bool is_binary_data_file(StorageFile& file){
+    if(file.size()==0) return true;
+    char magic[sizeof(DATA_FILE_MAGIC)];
+    if(file.read_at(0,magic,sizeof(magic))!=sizeof(magic)) return false;
+    return memcmp(magic,DATA_FILE_MAGIC,sizeof(magic))==0;
+}
+#endif
@@ -0,0 +1,27 @@
+#ifndef SIMD_H
+#define SIMD_H
+//the x86 SIMD kernels are compiled next to their scalar loop with a target attribute, so a build without -mavx2 still
+//has them, and simd_level picks one at runtime by what the cpu has
+#if (defined(__x86_64__)||defined(__i386__))&&(defined(__GNUC__)||defined(__clang__))
+#define SIMD_X86
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+using namespace std;
+
+enum class SimdLevel{SCALAR,SSE42,AVX2};
+inline SimdLevel cpu_simd_level(){
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return SimdLevel::AVX2;
+    if(__builtin_cpu_supports("sse4.2")) return SimdLevel::SSE42;
+#endif
+    return SimdLevel::SCALAR;
+}
+//the kernels the scans and index lookups run, the best the cpu has (the tests lower it to check every kernel)
+inline SimdLevel simd_level=cpu_simd_level();
+inline const char* simd_name(SimdLevel level){
+    return level==SimdLevel::AVX2?"avx2":level==SimdLevel::SSE42?"sse4.2":"scalar";
+}
+#endif
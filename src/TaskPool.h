@@ -0,0 +1,174 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+using namespace std;
+inline size_t task_threads=max(1u,thread::hardware_concurrency()); //workers of the pool, read when it is first used
+
+//work stealing thread pool shared by the engine (scans, restore, sorting rows of a LOAD).
+//every worker has its own deque: a task submitted from a worker goes to the back of its deque and the worker takes
+//from the back (the newest, its data is still in the cache), an idle worker steals from the front of another deque.
+//tasks submitted from other threads are spread over the deques round robin. a thread waiting for a future of the
+//pool runs tasks meanwhile (wait), so tasks can wait for the tasks they submitted without running out of workers.
+//with nothing queued it sleeps until a task is queued or one finished
+class TaskPool{
+    struct Worker{
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+    mutex sleep_lock;
+    condition_variable wake;
+    condition_variable progress; //for the threads in wait_until, a task was queued or finished
+    atomic<size_t> queued=0; //tasks in the deques
+    atomic<size_t> next_worker=0; //round robin for tasks from outside the pool
+    bool stopping=false;
+    static inline thread_local TaskPool* current_pool=nullptr;
+    static inline thread_local size_t current_worker=0;
+
+    void push(function<void()> task){
+        size_t w=current_pool==this?current_worker:next_worker++%workers.size();
+        {
+            lock_guard<mutex> guard(workers[w]->lock);
+            workers[w]->tasks.push_back(move(task));
+        }
+        queued++;
+        {
+            lock_guard<mutex> guard(sleep_lock); //a worker between checking queued and sleeping doesnt miss it
+        }
+        wake.notify_one();
+        progress.notify_all();
+    }
+    void run(function<void()>& task){
+        task();
+        task=nullptr;
+        {
+            lock_guard<mutex> guard(sleep_lock); //a waiter between checking its condition and sleeping doesnt miss it
+        }
+        progress.notify_all();
+    }
+    //the newest task of the own deque, else the oldest of another one
+    bool pop(function<void()>& task){
+        size_t own=current_pool==this?current_worker:next_worker%workers.size();
+        for(size_t i=0;i<workers.size();i++){
+            Worker& worker=*workers[(own+i)%workers.size()];
+            lock_guard<mutex> guard(worker.lock);
+            if(worker.tasks.empty()) continue;
+            if(i==0&&current_pool==this){
+                task=move(worker.tasks.back());
+                worker.tasks.pop_back();
+            }
+            else{
+                task=move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            queued--;
+            return true;
+        }
+        return false;
+    }
+    void work(size_t w){
+        current_pool=this;
+        current_worker=w;
+        function<void()> task;
+        while(true){
+            if(pop(task)){
+                run(task);
+                continue;
+            }
+            unique_lock<mutex> guard(sleep_lock);
+            wake.wait(guard,[&]{ return stopping||queued>0; });
+            if(stopping&&queued==0) return;
+        }
+    }
+public:
+    explicit TaskPool(size_t count){
+        count=max<size_t>(count,1);
+        for(size_t i=0;i<count;i++) workers.push_back(make_unique<Worker>());
+        for(size_t i=0;i<count;i++) threads.emplace_back(&TaskPool::work,this,i);
+    }
+    TaskPool(const TaskPool&)=delete;
+    TaskPool& operator=(const TaskPool&)=delete;
+    //the tasks already submitted are run first
+    ~TaskPool(){
+        {
+            lock_guard<mutex> guard(sleep_lock);
+            stopping=true;
+        }
+        wake.notify_all();
+        for(thread& t:threads) t.join();
+    }
+    size_t size() const { return threads.size(); }
+    template<typename F>
+    future<invoke_result_t<F>> submit(F f){
+        auto task=make_shared<packaged_task<invoke_result_t<F>()>>(move(f));
+        future<invoke_result_t<F>> result=task->get_future();
+        push([task]{ (*task)(); });
+        return result;
+    }
+    //runs one queued task on this thread, false if there was none
+    bool run_one(){
+        function<void()> task;
+        if(!pop(task)) return false;
+        run(task);
+        return true;
+    }
+    //runs tasks of the pool until ready() holds (checked again after every task of the pool)
+    void wait_until(const function<bool()>& ready){
+        while(!ready()){
+            if(run_one()) continue;
+            unique_lock<mutex> guard(sleep_lock);
+            progress.wait(guard,[&]{ return queued>0||ready(); });
+        }
+    }
+    //waits for result, running tasks of the pool until it is ready
+    template<typename T>
+    void wait(const future<T>& result){
+        wait_until([&]{ return result.wait_for(chrono::seconds(0))==future_status::ready; });
+    }
+    //runs body(i) for every i below n on the pool and this thread and waits for all of them,
+    //the first exception is thrown after every task finished
+    void parallel_for(size_t n,const function<void(size_t)>& body){
+        vector<future<void>> results;
+        for(size_t i=0;i<n;i++) results.push_back(submit([&body,i]{ body(i); }));
+        for(future<void>& result:results) wait(result);
+        for(future<void>& result:results) result.get();
+    }
+};
+
+//the pool of the engine, started with task_threads workers the first time it is used
+inline TaskPool& task_pool(){
+    static TaskPool pool(task_threads);
+    return pool;
+}
+
+//sorts [first,last) with the pool: chunks are sorted by their own tasks and then merged in pairs
+template<typename It,typename Compare>
+void parallel_sort(It first,It last,Compare compare,size_t min_chunk=1<<14){
+    size_t n=last-first,chunks=min(task_pool().size(),n/max<size_t>(min_chunk,1));
+    if(chunks<2){
+        sort(first,last,compare);
+        return;
+    }
+    vector<size_t> bounds;
+    for(size_t i=0;i<=chunks;i++) bounds.push_back(n*i/chunks);
+    task_pool().parallel_for(chunks,[&](size_t i){ sort(first+bounds[i],first+bounds[i+1],compare); });
+    for(size_t width=1;width<chunks;width*=2){
+        size_t pairs=(chunks+2*width-1)/(2*width);
+        task_pool().parallel_for(pairs,[&](size_t i){
+            size_t lo=2*width*i,mid=min(lo+width,chunks),hi=min(lo+2*width,chunks);
+            if(mid<hi) inplace_merge(first+bounds[lo],first+bounds[mid],first+bounds[hi],compare);
+        });
+    }
+}
+#endif
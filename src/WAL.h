@@ -0,0 +1,266 @@
+#ifndef WAL_H
+#define WAL_H
+#define WAL_FILE "DB_files/DB_wal.log"
+#define WAL_FORMAT_VERSION 2
+#define DEFAULT_WAL_SYNC_RECORDS 64
+#define DEFAULT_WAL_SYNC_MS 10
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Record.h"
+using namespace std;
+//write ahead log of the insert/delete commands.
+//file header: "TSQLWAL" + u8 version, then records
+//record: u32 payload length, u32 crc32 of the payload,
+//payload = u64 lsn + u32 number of tokens + (u32 length + bytes) per token.
+//lsn (log sequence number) grows by one per record and keeps growing across checkpoints,
+//a checkpoint remembers the last lsn it covers so replay can skip what is already applied.
+//(version 1 logs had no header and no lsn)
+//every record is written to the file when it is appended (a crashed process loses nothing),
+//when the file is synced to the disk depends on the policy (group commit)
+enum class WalSyncPolicy{
+    EVERY_COMMIT, //fdatasync after every record
+    EVERY_N_RECORDS, //fdatasync once sync_records records are waiting
+    EVERY_T_MS //a background thread syncs every sync_ms milliseconds if something is waiting
+};
+struct WalConfig{
+    WalSyncPolicy policy=WalSyncPolicy::EVERY_T_MS;
+    size_t sync_records=DEFAULT_WAL_SYNC_RECORDS;
+    int sync_ms=DEFAULT_WAL_SYNC_MS;
+};
+
+class WAL{
+    int fd=-1;
+    WalConfig config;
+    mutex lock;
+    condition_variable wake_flusher;
+    thread flusher;
+    bool stop_flusher=false;
+    size_t unsynced=0; //records written but not synced
+    size_t syncs=0;
+    off_t file_size=0; //end of the last whole record, a record written half way is cut back to it
+    void open_file(){
+        if(fd>=0) return;
+        fd=::open(WAL_FILE,O_WRONLY|O_CREAT|O_APPEND,0644);
+        if(fd<0){
+            cerr<<"Error opening write ahead log"<<endl;
+            return;
+        }
+        struct stat st;
+        file_size=fstat(fd,&st)==0?st.st_size:0;
+        if(file_size==0&&!write_all(header())){
+            ::close(fd);
+            fd=-1;
+        }
+    }
+    //false if the disk did not take the records, they stay unsynced and the next sync tries again
+    bool sync_locked(){
+        if(fd>=0&&unsynced>0){
+            if(fdatasync(fd)!=0){
+                cerr<<"Error syncing write ahead log"<<endl;
+                return false;
+            }
+            syncs++;
+        }
+        unsynced=0;
+        return true;
+    }
+    uint64_t next_lsn=1;
+    //false if data was not written whole, what was written of it is cut off so the log still ends in a whole record
+    bool write_all(const string& data){
+        size_t done=0;
+        while(fd>=0&&done<data.size()){
+            ssize_t n=::write(fd,data.data()+done,data.size()-done);
+            if(n<0){
+                if(errno==EINTR) continue;
+                cerr<<"Error writing write ahead log"<<endl;
+                break;
+            }
+            done+=n;
+        }
+        if(fd>=0&&done==data.size()){
+            file_size+=done;
+            return true;
+        }
+        if(done>0&&::ftruncate(fd,file_size)!=0) cerr<<"Error cutting a torn record off the write ahead log"<<endl;
+        return false;
+    }
+    void flusher_loop(){
+        unique_lock<mutex> guard(lock);
+        while(!stop_flusher){
+            wake_flusher.wait_for(guard,chrono::milliseconds(config.sync_ms));
+            sync_locked();
+        }
+    }
+    void stop(){
+        {
+            lock_guard<mutex> guard(lock);
+            stop_flusher=true;
+        }
+        wake_flusher.notify_all();
+        if(flusher.joinable()) flusher.join();
+        stop_flusher=false;
+    }
+public:
+    WAL(){ configure(WalConfig()); }
+    WAL(const WAL&)=delete;
+    WAL& operator=(const WAL&)=delete;
+    ~WAL(){
+        stop();
+        close();
+    }
+    void configure(const WalConfig& new_config){
+        stop();
+        lock_guard<mutex> guard(lock);
+        sync_locked();
+        config=new_config;
+        if(config.policy==WalSyncPolicy::EVERY_T_MS) flusher=thread(&WAL::flusher_loop,this);
+    }
+    static string header(){
+        string magic="TSQLWAL";
+        magic+=(char)WAL_FORMAT_VERSION;
+        return magic;
+    }
+    static string encode(uint64_t lsn,const vector<string>& command){
+        string payload;
+        auto put_u32=[&](uint32_t v){ payload.append((const char*)&v,sizeof(v)); };
+        payload.append((const char*)&lsn,sizeof(lsn));
+        put_u32(command.size());
+        for(const string& token:command){
+            put_u32(token.size());
+            payload+=token;
+        }
+        string record;
+        uint32_t len=payload.size(),crc=crc32(payload.data(),payload.size());
+        record.append((const char*)&len,sizeof(len));
+        record.append((const char*)&crc,sizeof(crc));
+        record+=payload;
+        return record;
+    }
+    //returns the lsn given to the command. throws if the record was not written, or not synced when the policy
+    //syncs with this record, so a command is never acknowledged before the log has it as promised
+    uint64_t append(const vector<string>& command){
+        lock_guard<mutex> guard(lock);
+        open_file();
+        if(!write_all(encode(next_lsn,command))) throw runtime_error("Error writing write ahead log");
+        uint64_t lsn=next_lsn++;
+        unsynced++;
+        if(config.policy==WalSyncPolicy::EVERY_COMMIT||
+            (config.policy==WalSyncPolicy::EVERY_N_RECORDS&&unsynced>=config.sync_records)){
+            if(!sync_locked()) throw runtime_error("Error syncing write ahead log");
+        }
+        return lsn;
+    }
+    uint64_t last_lsn(){
+        lock_guard<mutex> guard(lock);
+        return next_lsn-1;
+    }
+    //forces everything appended so far to the disk, false if it failed
+    bool sync(){
+        lock_guard<mutex> guard(lock);
+        return sync_locked();
+    }
+    size_t sync_count(){
+        lock_guard<mutex> guard(lock);
+        return syncs;
+    }
+    //drops every record (they are covered by a checkpoint), lsns keep growing
+    void reset(){
+        lock_guard<mutex> guard(lock);
+        unsynced=0;
+        if(fd>=0){
+            ::close(fd);
+            fd=-1;
+        }
+        ::unlink(WAL_FILE);
+    }
+    void close(){
+        lock_guard<mutex> guard(lock);
+        sync_locked();
+        if(fd>=0){
+            ::close(fd);
+            fd=-1;
+        }
+    }
+    struct Record{
+        uint64_t lsn; //0 for version 1 records
+        vector<string> command;
+    };
+    //reads the records in the log, stops at the first torn or corrupted record (the tail of a crash).
+    //valid_end is set to the end of the last good record
+    static vector<Record> read_all(size_t* valid_end=nullptr){
+        vector<Record> records;
+        if(valid_end) *valid_end=0;
+        int in=::open(WAL_FILE,O_RDONLY);
+        if(in<0) return records;
+        string content;
+        struct stat st;
+        if(fstat(in,&st)==0){
+            content.resize(st.st_size);
+            size_t done=0;
+            while(done<content.size()){
+                ssize_t n=::read(in,content.data()+done,content.size()-done);
+                if(n<0&&errno==EINTR) continue;
+                if(n<=0) break;
+                done+=n;
+            }
+            content.resize(done);
+        }
+        ::close(in);
+        auto get_u32=[&](size_t pos){ uint32_t v; memcpy(&v,content.data()+pos,sizeof(v)); return v; };
+        size_t pos=0;
+        bool has_lsn=content.compare(0,header().size(),header())==0;
+        if(has_lsn) pos=header().size();
+        if(valid_end) *valid_end=pos;
+        while(pos+2*sizeof(uint32_t)<=content.size()){
+            uint32_t len=get_u32(pos),crc=get_u32(pos+sizeof(uint32_t));
+            size_t start=pos+2*sizeof(uint32_t);
+            if(start+len>content.size()||crc32(content.data()+start,len)!=crc) break;
+            Record record{0,{}};
+            size_t p=start,end=start+len;
+            if(has_lsn){
+                if(p+sizeof(uint64_t)>end) break;
+                memcpy(&record.lsn,content.data()+p,sizeof(uint64_t));
+                p+=sizeof(uint64_t);
+            }
+            bool ok=p+sizeof(uint32_t)<=end;
+            uint32_t count=ok?get_u32(p):0;
+            p+=sizeof(uint32_t);
+            for(uint32_t i=0;ok&&i<count;i++){
+                if(p+sizeof(uint32_t)>end){ ok=false; break; }
+                uint32_t token_len=get_u32(p);
+                p+=sizeof(uint32_t);
+                if(p+token_len>end){ ok=false; break; }
+                record.command.emplace_back(content.data()+p,token_len);
+                p+=token_len;
+            }
+            if(!ok) break;
+            records.push_back(move(record));
+            pos=end;
+            if(valid_end) *valid_end=pos;
+        }
+        return records;
+    }
+    //after recovery: cuts a torn tail so new records follow the last good one, next lsn is after last_lsn
+    void resume(size_t valid_end,uint64_t last_lsn){
+        lock_guard<mutex> guard(lock);
+        if(fd>=0){
+            ::close(fd);
+            fd=-1;
+        }
+        if(::truncate(WAL_FILE,valid_end)!=0&&errno!=ENOENT) cerr<<"Error truncating write ahead log"<<endl;
+        next_lsn=last_lsn+1;
+    }
+};
+#endif
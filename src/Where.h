@@ -0,0 +1,182 @@
+#ifndef WHERE_H
+#define WHERE_H
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Record.h"
+using namespace std;
+//the WHERE of a SELECT is parsed once into an expression tree, the table compiles it into a RowFilter
+//(columns resolved to their place in the row, values typed) that is checked once per row as it is read.
+//tokens are split by spaces, a clause is column op value with no spaces and parentheses may be glued to it:
+//    or     := and (OR and)*
+//    and    := not (AND not | not)*     clauses next to each other are ANDed
+//    not    := NOT not | ( or ) | clause
+//    op     := >= <= > < == !=
+enum class CmpOp{LT,LE,EQ,NE,GE,GT};
+
+struct WhereExpr{
+    enum Kind{CLAUSE,AND,OR,NOT};
+    Kind kind=CLAUSE;
+    string column; //of a clause
+    string op;
+    string value; //as written (strings with their quotes)
+    vector<unique_ptr<WhereExpr>> children;
+};
+
+inline CmpOp to_cmp_op(const string& op){
+    if(op=="<") return CmpOp::LT;
+    if(op=="<=") return CmpOp::LE;
+    if(op=="==") return CmpOp::EQ;
+    if(op=="!=") return CmpOp::NE;
+    if(op==">=") return CmpOp::GE;
+    if(op==">") return CmpOp::GT;
+    throw invalid_argument("UNKONWN COMPARSION OPERATOR (SHOULD ONLY BE >= <= > < != ==)");
+}
+
+//true when a value that compares to the literal as cmp (<0, 0, >0) passes op
+inline bool cmp_passes(CmpOp op,int cmp){
+    switch(op){
+        case CmpOp::LT: return cmp<0;
+        case CmpOp::LE: return cmp<=0;
+        case CmpOp::EQ: return cmp==0;
+        case CmpOp::NE: return cmp!=0;
+        case CmpOp::GE: return cmp>=0;
+        case CmpOp::GT: return cmp>0;
+    }
+    return false;
+}
+
+class WhereParser{
+    vector<string> tokens;
+    size_t pos=0;
+    bool at(const string& token) const { return pos<tokens.size()&&tokens[pos]==token; }
+    unique_ptr<WhereExpr> combine(WhereExpr::Kind kind,unique_ptr<WhereExpr> left,unique_ptr<WhereExpr> right){
+        auto node=make_unique<WhereExpr>();
+        node->kind=kind;
+        node->children.push_back(move(left));
+        node->children.push_back(move(right));
+        return node;
+    }
+    unique_ptr<WhereExpr> parse_or(){
+        auto left=parse_and();
+        while(at("OR")){
+            pos++;
+            left=combine(WhereExpr::OR,move(left),parse_and());
+        }
+        return left;
+    }
+    unique_ptr<WhereExpr> parse_and(){
+        auto left=parse_not();
+        while(pos<tokens.size()&&!at("OR")&&!at(")")){
+            if(at("AND")) pos++;
+            left=combine(WhereExpr::AND,move(left),parse_not());
+        }
+        return left;
+    }
+    unique_ptr<WhereExpr> parse_not(){
+        if(pos>=tokens.size()) throw invalid_argument("WHERE clause ends in the middle of an expression");
+        if(at("NOT")){
+            pos++;
+            auto node=make_unique<WhereExpr>();
+            node->kind=WhereExpr::NOT;
+            node->children.push_back(parse_not());
+            return node;
+        }
+        if(at("(")){
+            pos++;
+            auto inner=parse_or();
+            if(!at(")")) throw invalid_argument("missing ) in WHERE clause");
+            pos++;
+            return inner;
+        }
+        return parse_clause(tokens[pos++]);
+    }
+    //column op value, the op is the first of < > = ! in the clause (column names dont have them)
+    static unique_ptr<WhereExpr> parse_clause(const string& clause){
+        size_t i=clause.find_first_of("<>=!");
+        if(i==string::npos||i==0) throw invalid_argument("invalid WHERE clause "+clause);
+        size_t len=i+1<clause.size()&&clause[i+1]=='='?2:1;
+        auto node=make_unique<WhereExpr>();
+        node->column=clause.substr(0,i);
+        node->op=clause.substr(i,len);
+        node->value=clause.substr(i+len);
+        to_cmp_op(node->op);
+        if(node->value.empty()) throw invalid_argument("invalid WHERE clause "+clause);
+        return node;
+    }
+public:
+    //the tokens after WHERE, parentheses glued to a clause are split off first
+    explicit WhereParser(const vector<string>& where_tokens){
+        for(const string& token:where_tokens){
+            if(token.empty()) continue;
+            size_t begin=0,end=token.size();
+            for(;begin<end&&token[begin]=='(';begin++) tokens.push_back("(");
+            size_t closing=0;
+            for(;end>begin&&token[end-1]==')';end--) closing++; //a value ends with a quote or a digit, never with )
+            if(end>begin) tokens.push_back(token.substr(begin,end-begin));
+            for(;closing>0;closing--) tokens.push_back(")");
+        }
+    }
+    unique_ptr<WhereExpr> parse(){
+        if(tokens.empty()) throw invalid_argument("there is WHERE word but no clauses");
+        auto expr=parse_or();
+        if(pos<tokens.size()) throw invalid_argument("unexpected "+tokens[pos]+" in WHERE clause");
+        return expr;
+    }
+};
+
+//a compiled WHERE, the nodes are in one vector and point to their children by index
+class RowFilter{
+public:
+    struct Node{
+        WhereExpr::Kind kind;
+        CmpOp op=CmpOp::EQ;
+        int column=-1; //place in the row, -1 for a KEY clause (compares the encoded key of the row)
+        bool is_int=false;
+        int64_t int_value=0;
+        string str_value; //without quotes, the encoded key of a KEY clause
+        vector<int> children;
+    };
+    vector<Node> nodes;
+    int root=-1; //-1 when every row passes
+    vector<string> key_types; //types of the key columns, the first columns of a row
+
+    //one row at a time, scans filter a batch by column with select_batch. kept as the reference the tests check the
+    //batch kernels against
+    bool passes(const vector<string>& row) const {
+        if(root<0) return true;
+        string key;
+        return eval(root,row,key);
+    }
+private:
+    bool eval(int at,const vector<string>& row,string& key) const {
+        const Node& node=nodes[at];
+        switch(node.kind){
+            case WhereExpr::AND:
+                for(int child:node.children) if(!eval(child,row,key)) return false;
+                return true;
+            case WhereExpr::OR:
+                for(int child:node.children) if(eval(child,row,key)) return true;
+                return false;
+            case WhereExpr::NOT:
+                return !eval(node.children[0],row,key);
+            case WhereExpr::CLAUSE:
+                break;
+        }
+        if(node.column<0){
+            if(key.empty()) for(size_t i=0;i<key_types.size();i++) append_key_column(key,row[i],key_types[i]);
+            return cmp_passes(node.op,key.compare(node.str_value));
+        }
+        const string& value=row[node.column];
+        if(node.is_int){
+            int64_t v=0;
+            from_chars(value.data(),value.data()+value.size(),v);
+            return cmp_passes(node.op,v<node.int_value?-1:v>node.int_value?1:0);
+        }
+        return cmp_passes(node.op,value.compare(node.str_value));
+    }
+};
+#endif
@@ -18,26 +18,35 @@ void parse_command(const string& command) {
     }
     else if(cmd=="INSERT")
     {
-            db.add_record(tokens);
+            bool checkpointed=db.add_record(tokens);
             cout<<"Record inserted successfully."<<endl;
+            if(!checkpointed) cout<<"Checkpoint failed, the changes stay in the log."<<endl;
     }
     else if(cmd=="DELETE")
     {
-            db.remove_record(tokens);
+            bool checkpointed=db.remove_record(tokens);
             cout<<"Record deleted successfully."<<endl;
+            if(!checkpointed) cout<<"Checkpoint failed, the changes stay in the log."<<endl;
+    }
+    else if(cmd=="LOAD")
+    {
+            size_t loaded=db.load_table(tokens);
+            cout<<loaded<<" records loaded."<<endl;
     }
     else if(cmd=="SELECT")
     {
         
-            vector<string> results=db.select_records(tokens);
-            if(results.empty()){
-                cout<<"No records found."<<endl;
-            }
-            else{
-                for(const string& rec:results){
-                    cout<<rec<<endl;
-                }
-            }
+            size_t found=0;
+            db.select_rows(tokens,[&](const string& rec){ //printed as the rows are read
+                cout<<rec<<'\n';
+                found++;
+                return true;
+            });
+            if(found==0) cout<<"No records found."<<endl;
+            else cout<<flush;
+    }
+    else if (cmd=="STATS"){
+        for(const string& line:db.stats()) cout<<line<<endl;
     }
     else if (cmd=="GC"){
         //call garbage collector
@@ -46,7 +55,7 @@ void parse_command(const string& command) {
     }
     else if (cmd=="EXIT")
     {
-        db.GC(); //final GC before exit
+        db.checkpoint(); //final checkpoint before exit, only what changed is written
         cout<<"Exiting program."<<endl;
         exit(0);
         //add gc and serialization here
@@ -55,7 +64,54 @@ void parse_command(const string& command) {
         throw invalid_argument("Unknown command: "+cmd);
     }
 }
-int main(){
+int main(int argc,char** argv){
+    for(int i=1;i<argc;i++){
+        string arg=argv[i];
+        if(arg=="--buffer-pool-mb"&&i+1<argc){
+            //a memory budget means reads go through the pool instead of the mmap of the files
+            buffer_pool.resize((size_t)stoul(argv[++i])<<20);
+            mmap_reads=false;
+        }
+        else if(arg=="--wal-sync"&&i+1<argc){
+            //commit (sync every record), records:N (sync every N records) or ms:T (sync every T ms in the background)
+            string policy=argv[++i];
+            WalConfig config;
+            if(policy=="commit") config.policy=WalSyncPolicy::EVERY_COMMIT;
+            else if(policy.rfind("records:",0)==0){
+                config.policy=WalSyncPolicy::EVERY_N_RECORDS;
+                config.sync_records=stoul(policy.substr(8));
+            }
+            else if(policy.rfind("ms:",0)==0){
+                config.policy=WalSyncPolicy::EVERY_T_MS;
+                config.sync_ms=stoi(policy.substr(3));
+            }
+            else{
+                cout<<"unknown --wal-sync policy: "<<policy<<endl;
+                return 1;
+            }
+            db.wal.configure(config);
+        }
+        else if(arg=="--compaction-mb-per-s"&&i+1<argc){
+            //bandwidth of the background compaction, 0 for no limit
+            compaction_mb_per_s=stod(argv[++i]);
+        }
+        else if(arg=="--compaction-dead-ratio"&&i+1<argc){
+            //share of garbage in a data file that gets the table compacted
+            compaction_dead_ratio=stod(argv[++i]);
+        }
+        else if(arg=="--threads"&&i+1<argc){
+            //workers of the engine's task pool (scans, restore, sorting for LOAD)
+            task_threads=max(1,stoi(argv[++i]));
+        }
+        else if(arg=="--scan-threads"&&i+1<argc){
+            //threads a select scans the rows with, 1 to scan on the command thread only
+            scan_threads=max(1,stoi(argv[++i]));
+        }
+        else{
+            cout<<"usage: main [--buffer-pool-mb N] [--wal-sync commit|records:N|ms:T] [--compaction-mb-per-s N] [--compaction-dead-ratio R] [--threads N] [--scan-threads N]"<<endl;
+            return 1;
+        }
+    }
     cout<<"Hello and welcome to SQL_lite"<<endl;
     cout<<"Would you like to load the last DB created?(Y/N)"<<endl;
     string line;
@@ -64,6 +120,10 @@ int main(){
                if(filesystem::exists("DB_files")){
                     db.deserialize_DB();
                     cout<<"Data restored"<<endl;
+                    if(db.recovery.replayed+db.recovery.skipped>0){
+                         cout<<"log replay: "<<db.recovery.replayed<<" records applied, "<<db.recovery.skipped<<" already checkpointed, "
+                             <<db.recovery.ms<<" ms ("<<(size_t)(db.recovery.replayed/max(db.recovery.ms,0.001)*1000)<<" records/s)"<<endl;
+                    }
                }
                else cout<<"there is no state saved so starting over"<<endl;
                break;
@@ -81,7 +141,7 @@ int main(){
     }
     //reload data from files
     while(true){
-        cout<<"Enter Command (create,insert,delete,select)"<<endl;
+        cout<<"Enter Command (create,insert,delete,select,load,stats)"<<endl;
         getline(cin,line);
         parse_command(line);
     }
@@ -24,6 +24,11 @@ void parse_command(const string& command) {
             db.remove_record(tokens);
             //cout<<"Record deleted successfully."<<endl;
     }
+    else if(cmd=="LOAD")
+    {
+            db.load_table(tokens);
+            //cout<<"records loaded."<<endl;
+    }
     else if(cmd=="SELECT")
     {
         
@@ -44,7 +49,7 @@ void parse_command(const string& command) {
     }
     else if (cmd=="EXIT")
     {
-        db.GC(); //final GC before exit
+        db.checkpoint(); //final checkpoint before exit, only what changed is written
         //cout<<"Exiting program."<<endl;
         //add gc and serialization here
     }
@@ -70,6 +75,24 @@ void parse_command(const string& command) {
        } \
    }
 
+// Runs a SELECT and checks the printed rows
+#define RUN_SELECT_TEST(line_str, expected_rows) \
+   line = line_str; \
+   { \
+       vector<string> tokens; \
+       stringstream ss(line); \
+       string token; \
+       while(getline(ss,token,' ')) tokens.push_back(token); \
+       vector<string> got = db.select_records(tokens); \
+       vector<string> wanted = expected_rows; \
+       if (got != wanted) { \
+           string got_str; \
+           for (const string& r : got) got_str += "[" + r + "]"; \
+           throw std::invalid_argument("FAIL IN TEST: " + line + " Got: " + got_str); \
+       } \
+       std::cout << "Success in TEST " << line << std::endl; \
+   }
+
 int main() {
     filesystem::create_directory("DB_files");
     std::string line;
@@ -359,6 +382,786 @@ int main() {
     } catch (const std::invalid_argument& e) {
         throw std::invalid_argument("FAIL IN TEST: " + line + " Got: " + e.what() + " Wanted: Success");
     }
+    // Binary records keep strings with spaces and ints as typed values
+    {
+        vector<string> types = {"S", "I"};
+        string encoded = encode_record({"hello big world", "-42"}, types);
+        vector<Value> values;
+        if (!decode_record(encoded.data() + sizeof(uint32_t), encoded.size() - sizeof(uint32_t), types, values)
+            || values.size() != 2 || values[0].str_value != "hello big world" || values[1].int_value != -42) {
+            throw std::invalid_argument("FAIL IN TEST: binary record round trip");
+        }
+        std::cout << "Success in TEST binary record round trip" << std::endl;
+    }
+    // Index keys compare like their columns with one memcmp and decode back
+    {
+        vector<string> types = {"I", "S"};
+        vector<vector<string>> keys = {{"-5", "b"}, {"9", ""}, {"9", "a"}, {"9", string("a\0", 2)}, {"9", "ab"}, {"10", "a"}};
+        vector<string> columns;
+        for (size_t i = 0; i < keys.size(); i++) {
+            string key = encode_key(keys[i], types);
+            columns.clear();
+            if ((i > 0 && !(encode_key(keys[i - 1], types) < key)) || !decode_key(key, types, columns) || columns != keys[i]) {
+                throw std::invalid_argument("FAIL IN TEST: key encoding of " + keys[i][0] + " " + keys[i][1]);
+            }
+        }
+        std::cout << "Success in TEST key encoding" << std::endl;
+    }
+    // The branchless search of int64 nodes finds the same positions as lower_bound/upper_bound
+    {
+        for (int64_t n = 0; n <= 40; n++) {
+            vector<int64_t> keys;
+            for (int64_t i = 0; i < n; i++) keys.push_back(i * 3 - 30);
+            if (n == 40) keys = {INT64_MIN, -1, 0, INT64_MAX};
+            vector<int64_t> probes = {INT64_MIN, INT64_MAX};
+            for (int64_t key = -33; key <= n * 3 - 27; key++) probes.push_back(key);
+            for (int64_t key : probes) {
+                if (node_bound<false>(keys, key) != (size_t)(lower_bound(keys.begin(), keys.end(), key) - keys.begin())
+                    || node_bound<true>(keys, key) != (size_t)(upper_bound(keys.begin(), keys.end(), key) - keys.begin())) {
+                    throw std::invalid_argument("FAIL IN TEST: node search of " + to_string(key) + " in " + to_string(keys.size()) + " keys");
+                }
+            }
+        }
+        std::cout << "Success in TEST int64 node search" << std::endl;
+    }
+
+    // A database written with the old text data file is upgraded when it is loaded
+    db.clear();
+    file_manager.close_all();
+    filesystem::remove_all("DB_files");
+    filesystem::create_directory("DB_files");
+    {
+        ofstream("DB_files/DB.txt") << "CREATE U A:I B:S C:I KEY A" << endl;
+        ofstream("DB_files/U_data.txt") << "hello 7\nworld 8\n";
+        ofstream("DB_files/U_BPlusTree.txt") << "0 8\n";
+        ofstream("DB_files/U_BPlusTreeserialize.txt") << "1 2|1|0" << endl;
+    }
+    db.deserialize_DB();
+    RUN_SELECT_TEST("SELECT * FROM U", (vector<string>{"1 \"hello\" 7", "2 \"world\" 8"}));
+    if (!is_binary_data_file(file_manager.get("U_data"))) {
+        throw std::invalid_argument("FAIL IN TEST: text data file was not upgraded");
+    }
+    if (filesystem::exists("DB_files/U_BPlusTree.txt")) {
+        throw std::invalid_argument("FAIL IN TEST: old leaf value file still exists after the snapshot");
+    }
+    string snap_path = db.schemas["U"].index_tree->snapshot_path();
+    if (filesystem::exists("DB_files/U_BPlusTreeserialize.txt") || !filesystem::exists(snap_path)) {
+        throw std::invalid_argument("FAIL IN TEST: text snapshot was not replaced by the binary one");
+    }
+    { // a damaged snapshot is refused instead of loading a wrong tree
+        TreeIndex<int64_t> tree(MIN_DEGREE, "U_int_index");
+        string snap;
+        {
+            ifstream in(snap_path, ios::binary);
+            snap.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+        }
+        string key = db.schemas["U"].key_of({"2"});
+        if (!tree.tree.load_checkpoint() || tree.search(key) != db.schemas["U"].index_tree->search(key)) {
+            throw std::invalid_argument("FAIL IN TEST: binary snapshot round trip");
+        }
+        string damaged = snap;
+        damaged[damaged.size() / 2] ^= 1;
+        ofstream(snap_path, ios::binary | ios::trunc) << damaged;
+        BPlusTree<int64_t, int64_t> damaged_tree(MIN_DEGREE, "U_int_index");
+        if (damaged_tree.load_checkpoint()) {
+            throw std::invalid_argument("FAIL IN TEST: damaged snapshot was loaded");
+        }
+        ofstream(snap_path, ios::binary | ios::trunc) << snap;
+        std::cout << "Success in TEST binary tree snapshot" << std::endl;
+    }
+    parse_command("INSERT 3 \"again\" 9 TO U");
+    RUN_SELECT_TEST("SELECT * FROM U WHERE KEY>=2", (vector<string>{"2 \"world\" 8", "3 \"again\" 9"}));
+
+    // Reads through the mapping and through pread see the same rows, also after the file grew
+    file_manager.flush_all();
+    RUN_SELECT_TEST("SELECT * FROM U", (vector<string>{"1 \"hello\" 7", "2 \"world\" 8", "3 \"again\" 9"}));
+    parse_command("INSERT 4 \"more\" 10 TO U");
+    file_manager.flush_all();
+    mmap_reads = false;
+    RUN_SELECT_TEST("SELECT * FROM U WHERE KEY>=3", (vector<string>{"3 \"again\" 9", "4 \"more\" 10"}));
+    mmap_reads = true;
+    RUN_SELECT_TEST("SELECT * FROM U WHERE KEY>=3", (vector<string>{"3 \"again\" 9", "4 \"more\" 10"}));
+
+    // Commands in the write ahead log are replayed after a crash (no GC/EXIT), a torn last record is ignored
+    parse_command("CREATE W A:I B:S KEY A");
+    parse_command("INSERT 1 \"one\" TO W");
+    parse_command("INSERT 2 \"two\" TO W");
+    parse_command("INSERT 3 \"three\" TO W");
+    parse_command("DELETE 2 FROM W");
+    db.wal.sync();
+    db.clear();
+    {
+        ofstream torn(WAL_FILE, ios::binary | ios::app);
+        torn << string("\x20\x00\x00\x00garbage", 11);
+    }
+    db.deserialize_DB();
+    RUN_SELECT_TEST("SELECT * FROM W", (vector<string>{"1 \"one\"", "3 \"three\""}));
+    db.clear(); // crash again right after the recovery, the replayed commands must still be logged
+    db.deserialize_DB();
+    RUN_SELECT_TEST("SELECT * FROM W", (vector<string>{"1 \"one\"", "3 \"three\""}));
+
+    // Replay skips the records a checkpoint covers, a crash between the checkpoint and dropping the log applies nothing twice
+    {
+        vector<WAL::Record> before = WAL::read_all();
+        db.GC();
+        uint64_t checkpoint_lsn = DB::read_checkpoint();
+        if (before.empty() || checkpoint_lsn < before.back().lsn) {
+            throw std::invalid_argument("FAIL IN TEST: checkpoint doesnt cover the log");
+        }
+        parse_command("INSERT 4 \"four\" TO W");
+        parse_command("DELETE 1 FROM W");
+        { // put the checkpointed records back in front, like a crash before the log was dropped
+            string tail;
+            {
+                ifstream in(WAL_FILE, ios::binary);
+                tail.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            }
+            db.clear();
+            ofstream out(WAL_FILE, ios::binary | ios::trunc);
+            out << WAL::header();
+            for (const WAL::Record& record : before) out << WAL::encode(record.lsn, record.command);
+            out << tail.substr(WAL::header().size());
+        }
+        db.deserialize_DB();
+        if (db.recovery.skipped != before.size() || db.recovery.replayed != 2) {
+            throw std::invalid_argument("FAIL IN TEST: replay applied " + to_string(db.recovery.replayed) + " and skipped " + to_string(db.recovery.skipped));
+        }
+        RUN_SELECT_TEST("SELECT * FROM W", (vector<string>{"3 \"three\"", "4 \"four\""}));
+        parse_command("INSERT 5 \"five\" TO W"); // lsns keep growing after the replay
+        if (WAL::read_all().back().lsn <= checkpoint_lsn + 2) {
+            throw std::invalid_argument("FAIL IN TEST: lsn went back after recovery");
+        }
+    }
+
+    // A command the log cant take is reported as failed and taken back
+    db.checkpoint();
+    filesystem::create_directory(WAL_FILE); // the log file cant be opened
+    for (const string& failing : vector<string>{"INSERT 6 \"six\" TO W", "INSERT (7 \"a\") (8 \"b\") TO W", "DELETE 3 FROM W"}) {
+        try {
+            parse_command(failing);
+            throw std::invalid_argument("FAIL IN TEST: " + failing + " Got: Success Wanted: Error writing write ahead log");
+        } catch (const std::runtime_error& e) {
+            if (std::string(e.what()) != "Error writing write ahead log") throw std::invalid_argument("FAIL IN TEST: " + failing + " Got: " + e.what());
+        }
+    }
+    filesystem::remove(WAL_FILE);
+    RUN_SELECT_TEST("SELECT * FROM W", (vector<string>{"3 \"three\"", "4 \"four\"", "5 \"five\""}));
+
+    // The command that reaches the checkpoint threshold is logged first, a failed checkpoint leaves it in the log
+    db.number_of_ops = NUM_OF_OPS_FOR_GLOB_GC - 1;
+    filesystem::create_directory("DB_files/DB_checkpoint_temp.txt"); // the checkpoint lsn cant be written
+    if (db.add_record({"INSERT", "9", "\"nine\"", "TO", "W"}) || WAL::read_all().back().command[1] != "9") {
+        throw std::invalid_argument("FAIL IN TEST: command lost by a failed checkpoint");
+    }
+    filesystem::remove("DB_files/DB_checkpoint_temp.txt");
+    db.clear();
+    db.deserialize_DB();
+    RUN_SELECT_TEST("SELECT * FROM W WHERE KEY>=5", (vector<string>{"5 \"five\"", "9 \"nine\""}));
+
+    // A buffer pool of a few pages keeps evicting and writing back pages while rows are added and read
+    file_manager.flush_all();
+    buffer_pool.resize(4 * PAGE_SIZE);
+    mmap_reads = false;
+    parse_command("CREATE P A:I B:S KEY A");
+    {
+        string padding(200, 'x');
+        vector<string> expected;
+        for (int i = 100; i < 500; i++) { // three digits, int keys still compare as strings
+            parse_command("INSERT " + to_string(i) + " \"" + padding + to_string(i) + "\" TO P");
+            if (i >= 490) expected.push_back(to_string(i) + " \"" + padding + to_string(i) + "\"");
+        }
+        if (buffer_pool.stats.evictions == 0) {
+            throw std::invalid_argument("FAIL IN TEST: buffer pool never evicted a page");
+        }
+        RUN_SELECT_TEST("SELECT * FROM P WHERE KEY>=490", expected);
+        db.GC();
+        RUN_SELECT_TEST("SELECT * FROM P WHERE KEY>=490", expected);
+        if (db.select_records({"SELECT", "*", "FROM", "P"}).size() != 400) {
+            throw std::invalid_argument("FAIL IN TEST: rows lost with a small buffer pool");
+        }
+    }
+
+    // A checkpoint after a few changes only writes the changed nodes, the tree comes back from snapshot + delta
+    {
+        PrimaryIndex* tree = db.schemas["P"].index_tree.get();
+        size_t snapshot_bytes = tree->snapshot_bytes();
+        parse_command("INSERT 500 \"new\" TO P");
+        parse_command("INSERT 501 \"newer\" TO P");
+        for (int i = 100; i < 140; i++) parse_command("DELETE " + to_string(i) + " FROM P");
+        if (tree->dirty_count() == 0) {
+            throw std::invalid_argument("FAIL IN TEST: changed nodes are not tracked");
+        }
+        db.checkpoint();
+        if (tree->dirty_count() != 0 || tree->delta_bytes() == 0 || tree->delta_bytes() >= snapshot_bytes / 2) {
+            throw std::invalid_argument("FAIL IN TEST: checkpoint wrote " + to_string(tree->delta_bytes()) + " bytes of a " + to_string(snapshot_bytes) + " byte tree");
+        }
+        db.clear();
+        db.deserialize_DB();
+        if (db.recovery.replayed != 0 || db.select_records({"SELECT", "*", "FROM", "P"}).size() != 362) {
+            throw std::invalid_argument("FAIL IN TEST: rows after incremental checkpoint");
+        }
+        RUN_SELECT_TEST("SELECT * FROM P WHERE KEY>=500", (vector<string>{"500 \"new\"", "501 \"newer\""}));
+    }
+    mmap_reads = true;
+    file_manager.flush_all();
+    buffer_pool.resize((size_t)DEFAULT_BUFFER_POOL_MB << 20);
+
+    // A page whose write fails stays dirty and the flush reports the failure
+    {
+        DiskFile broken; // no descriptor, every write fails
+        BufferPool::Frame* page = buffer_pool.fetch(broken, 0);
+        memcpy(page->data, "row", 3);
+        page->valid = 3;
+        buffer_pool.unpin(page, true);
+        if (buffer_pool.flush_file(broken) || broken.dirty_pages.size() != 1 || !page->dirty) {
+            throw std::invalid_argument("FAIL IN TEST: failed page write was dropped");
+        }
+        broken.dirty_pages.clear();
+        page->dirty = false;
+        buffer_pool.drop_file(broken);
+    }
+
+    // bulk_load builds a valid tree that later inserts and removes keep working on
+    {
+        BPlusTree<vector<string>, streampos> tree(MIN_DEGREE, "bulk");
+        int next = 0;
+        tree.bulk_load([&](vector<string>& key, streampos& value) {
+            if (next == 1000) return false;
+            key = {to_string(1000 + next)};
+            value = streampos(next++);
+            return true;
+        });
+        for (int i = 0; i < 1000; i += 2) tree.remove({to_string(1000 + i)});
+        tree.insert({"1001x"}, streampos(-2));
+        vector<vector<string>> keys = tree.getAllKeys();
+        if (keys.size() != 501 || tree.search({"1999"}) != streampos(999) || tree.search({"1998"}).has_value()
+            || !is_sorted(keys.begin(), keys.end())) {
+            throw std::invalid_argument("FAIL IN TEST: bulk loaded tree");
+        }
+        std::cout << "Success in TEST bulk_load" << std::endl;
+    }
+
+    // Nodes come from the pools of their tree: a freed block is handed out again and clear gives back all of the memory
+    {
+        NodePool pool(100);
+        void* first = pool.allocate();
+        void* second = pool.allocate();
+        pool.deallocate(first);
+        if (pool.allocate() != first || (uintptr_t)second % CACHE_LINE != 0 || pool.used_bytes() != 2 * 128 || pool.reserved_bytes() < pool.used_bytes()) {
+            throw std::invalid_argument("FAIL IN TEST: node pool blocks");
+        }
+        BPlusTree<int64_t, int64_t> tree(32, "pool");
+        for (int64_t i = 0; i < 10000; i++) tree.insert(i, i);
+        size_t nodes = tree.node_count(), bytes = tree.memory_bytes();
+        for (int64_t i = 0; i < 10000; i += 2) tree.remove(i);
+        if (tree.node_count() >= nodes || tree.memory_bytes() != bytes || tree.search(9999) != 9999 || tree.search(9998).has_value()) {
+            throw std::invalid_argument("FAIL IN TEST: tree nodes from the pool");
+        }
+        tree.clear();
+        tree.insert(1, 2);
+        if (tree.node_count() != 1 || tree.search(1) != 2) {
+            throw std::invalid_argument("FAIL IN TEST: tree after clear");
+        }
+        BPlusTree<string, int64_t> strings(32, "pool_strings");
+        strings.insert(string(100, 'k'), 1);
+        strings.insert("short", 2);
+        if (strings.memory_bytes() != strings.leaf_pool.reserved_bytes() + 101) {
+            throw std::invalid_argument("FAIL IN TEST: index memory of long string keys");
+        }
+        std::cout << "Success in TEST node pool" << std::endl;
+    }
+
+    // string keys with long shared prefixes (tenant paths) are kept once per node, separators are cut short
+    {
+        auto path_key = [](int i) {
+            return "tenant-" + to_string(i % 7) + "/projects/warehouse/inventory/item-" + to_string(100000 + i * 7919 % 50000);
+        };
+        BPlusTree<string, int64_t> tree(3, "prefix_keys");
+        std::map<string, int64_t> expected;
+        for (int i = 0; i < 6000; i++) {
+            string key = path_key(i % 4000);
+            if (i % 5 == 4 || expected.count(key)) {
+                tree.remove(key);
+                expected.erase(key);
+            } else {
+                tree.insert(key, i);
+                expected[key] = i;
+            }
+        }
+        auto check = [&](BPlusTree<string, int64_t>& tree, const string& what) {
+            vector<pair<string, int64_t>> all = tree.getAllValues();
+            if (all != vector<pair<string, int64_t>>(expected.begin(), expected.end())) {
+                throw std::invalid_argument("FAIL IN TEST: " + what + " keys");
+            }
+            for (int i = 0; i < 4000; i += 37) {
+                string key = path_key(i);
+                auto it = expected.find(key);
+                if (tree.search(key) != (it == expected.end() ? nullopt : optional<int64_t>(it->second))) {
+                    throw std::invalid_argument("FAIL IN TEST: " + what + " search of " + key);
+                }
+            }
+            string lower = "tenant-3/projects/warehouse/inventory/item-12", upper = "tenant-3/projects/warehouse/inventory/item-13";
+            vector<string> in_range;
+            for (auto it = expected.lower_bound(lower); it != expected.end() && it->first <= upper; ++it) in_range.push_back(it->first);
+            if (tree.rangeQueryKeys(lower, upper) != in_range || in_range.empty()) {
+                throw std::invalid_argument("FAIL IN TEST: " + what + " range query");
+            }
+        };
+        check(tree, "prefix truncated tree");
+        size_t stored_bytes = 0, full_bytes = 0;
+        tree.visit_nodes([&](auto* node) {
+            for (const string& key : node->keys) {
+                stored_bytes += key.size();
+                full_bytes += node->prefix.size() + key.size();
+            }
+        });
+        // every key is as long as the first one, a separator only as long as it takes to tell its children apart
+        bool short_separators = all_of(tree.root->keys.begin(), tree.root->keys.end(), [&](const string& key) {
+            return tree.root->prefix.size() + key.size() < path_key(0).size();
+        });
+        if (stored_bytes * 5 > full_bytes || !short_separators) {
+            throw std::invalid_argument("FAIL IN TEST: keys were not prefix or suffix truncated");
+        }
+        tree.serialize_Tree();
+        BPlusTree<string, int64_t> loaded(3, "prefix_keys");
+        loaded.deserialize_Tree();
+        check(loaded, "reloaded prefix truncated tree");
+        loaded.remove_files();
+        std::cout << "Success in TEST prefix truncated string keys" << std::endl;
+    }
+
+    // LOAD reads CSV/TSV files in any order (a header line is skipped), big inputs are sorted in runs on disk
+    parse_command("CREATE L A:I B:S C:I KEY A");
+    parse_command("INSERT 150 \"inserted\" 0 TO L");
+    {
+        ofstream csv("DB_files/load_test.csv");
+        csv << "A,B,C\r\n";
+        for (int i = 299; i >= 100; i--) {
+            if (i != 150) csv << i << ",\"row, " << i << "\"," << i * 2 << "\r\n";
+        }
+        ofstream("DB_files/load_test.tsv") << "300\tlast\t1\n";
+        ofstream("DB_files/load_dup.csv") << "301,a,1\n150,b,2\n";
+    }
+    load_run_rows = 16;
+    parse_command("LOAD L FROM DB_files/load_test.csv");
+    parse_command("LOAD L FROM DB_files/load_test.tsv");
+    load_run_rows = LOAD_RUN_ROWS;
+    RUN_SELECT_TEST("SELECT * FROM L WHERE KEY>=298", (vector<string>{"298 \"row, 298\" 596", "299 \"row, 299\" 598", "300 \"last\" 1"}));
+    RUN_SELECT_TEST("SELECT * FROM L WHERE KEY==150", (vector<string>{"150 \"inserted\" 0"}));
+    line = "LOAD L FROM DB_files/load_dup.csv";
+    try {
+        parse_command(line);
+        throw std::invalid_argument("FAIL IN TEST: " + line + " Got: Success Wanted: Duplicate primary key.");
+    } catch (const std::invalid_argument& e) {
+        if (std::string(e.what()) != "Duplicate primary key.") throw std::invalid_argument("FAIL IN TEST: " + line + " Got: " + e.what());
+    }
+    if (db.select_records({"SELECT", "*", "FROM", "L"}).size() != 201 || filesystem::exists("DB_files/L_load_run_0.tmp")) {
+        throw std::invalid_argument("FAIL IN TEST: failed LOAD changed the table");
+    }
+    // into an empty table the index is built bottom up, the next LOAD inserts
+    parse_command("CREATE L2 A:I B:S C:I KEY A");
+    parse_command("LOAD L2 FROM DB_files/load_test.csv");
+    parse_command("LOAD L2 FROM DB_files/load_test.tsv");
+    if (db.select_records({"SELECT", "*", "FROM", "L2"}).size() != 200) {
+        throw std::invalid_argument("FAIL IN TEST: LOAD into an empty table");
+    }
+    db.clear();
+    db.deserialize_DB();
+    RUN_SELECT_TEST("SELECT * FROM L WHERE KEY==101", (vector<string>{"101 \"row, 101\" 202"}));
+    RUN_SELECT_TEST("SELECT * FROM L2 WHERE KEY>=299", (vector<string>{"299 \"row, 299\" 598", "300 \"last\" 1"}));
+
+    // a LOAD whose tree cant be written throws and loads nothing
+    parse_command("CREATE L3 A:I B:S C:I KEY A");
+    db.checkpoint(); // the empty tree is generation 1, the load writes generation 2
+    {
+        string snapshot = "DB_files/" + db.schemas["L3"].index_tree->file_name() + ".2.snap";
+        filesystem::create_directory(snapshot);
+        line = "LOAD L3 FROM DB_files/load_test.csv";
+        try {
+            parse_command(line);
+            throw std::invalid_argument("FAIL IN TEST: " + line + " Got: Success");
+        } catch (const std::runtime_error& e) {
+            if (std::string(e.what()) != "Error writing the loaded rows, nothing was loaded") throw std::invalid_argument("FAIL IN TEST: " + line + " Got: " + e.what());
+        }
+        filesystem::remove(snapshot);
+        if (!db.select_records({"SELECT", "*", "FROM", "L3"}).empty() || db.schemas["L3"].live_rows != 0) {
+            throw std::invalid_argument("FAIL IN TEST: failed LOAD left rows");
+        }
+    }
+
+    // INSERT of many rows checks them all before writing any and is one log record
+    parse_command("CREATE M A:I B:S KEY A");
+    {
+        size_t logged = WAL::read_all().size();
+        parse_command("INSERT (3 \"c\") (1 \"a\") ( 2 \"b\" ) TO M");
+        if (WAL::read_all().size() != logged + 1) {
+            throw std::invalid_argument("FAIL IN TEST: multi row INSERT wasnt one log record");
+        }
+        for (const string& bad : vector<string>{"INSERT (4 \"d\") (4 \"e\") TO M", "INSERT (5 \"e\") (2 \"x\") TO M"}) {
+            try {
+                parse_command(bad);
+                throw std::invalid_argument("FAIL IN TEST: " + bad + " Got: Success Wanted: Duplicate primary key.");
+            } catch (const std::invalid_argument& e) {
+                if (std::string(e.what()) != "Duplicate primary key.") throw std::invalid_argument("FAIL IN TEST: " + bad + " Got: " + e.what());
+            }
+        }
+        line = "INSERT (6 \"f\") (7) TO M";
+        try {
+            parse_command(line);
+            throw std::invalid_argument("FAIL IN TEST: " + line + " Got: Success");
+        } catch (const std::invalid_argument& e) {
+            if (std::string(e.what()).rfind("Invalid INSERT command", 0) != 0) throw std::invalid_argument("FAIL IN TEST: " + line + " Got: " + e.what());
+        }
+        RUN_SELECT_TEST("SELECT * FROM M", (vector<string>{"1 \"a\"", "2 \"b\"", "3 \"c\""}));
+        db.wal.sync();
+        db.clear(); // the batch comes back from the log
+        db.deserialize_DB();
+        RUN_SELECT_TEST("SELECT * FROM M", (vector<string>{"1 \"a\"", "2 \"b\"", "3 \"c\""}));
+    }
+
+    // the background compaction moves the rows out of the segments with the most garbage while commands keep changing the table
+    data_segment_bytes = 1024;
+    parse_command("CREATE G A:I B:S KEY A");
+    for (int i = 0; i < 300; i++) parse_command("INSERT " + to_string(i) + " \"row" + to_string(i) + "\" TO G");
+    for (int i = 0; i < 100; i++) parse_command("DELETE " + to_string(i) + " FROM G");
+    {
+        file_manager.flush_all();
+        if (db.schemas["G"].segments.size() < 4) throw std::invalid_argument("FAIL IN TEST: data file wasnt cut into segments");
+        uintmax_t untouched = filesystem::file_size(FileManager::path_of("G_data_3"));
+        compaction_chunk_rows = 8;
+        compaction_mb_per_s = 0;
+        db.request_compaction("G");
+        for (int i = 300; i < 350; i++) {
+            parse_command("INSERT " + to_string(i) + " \"row" + to_string(i) + "\" TO G");
+            parse_command("DELETE " + to_string(i - 150) + " FROM G"); // rows already moved or still waiting
+        }
+        db.wait_for_compactions();
+        compaction_chunk_rows = COMPACTION_CHUNK_ROWS;
+        compaction_mb_per_s = DEFAULT_COMPACTION_MB_PER_S;
+        file_manager.flush_all();
+        if (filesystem::exists(FileManager::path_of("G_data")) || filesystem::file_size(FileManager::path_of("G_data_3")) != untouched
+            || db.schemas["G"].compactions != 1) {
+            throw std::invalid_argument("FAIL IN TEST: background compaction didnt rewrite only the worst segments");
+        }
+        for (int restart = 0; restart < 2; restart++) {
+            vector<string> rows = db.select_records({"SELECT", "*", "FROM", "G"});
+            if (rows.size() != 200) throw std::invalid_argument("FAIL IN TEST: background compaction lost rows, got " + to_string(rows.size()));
+            RUN_SELECT_TEST("SELECT * FROM G WHERE KEY==100", (vector<string>{"100 \"row100\""}));
+            RUN_SELECT_TEST("SELECT * FROM G WHERE KEY==349", (vector<string>{"349 \"row349\""}));
+            RUN_SELECT_TEST("SELECT * FROM G WHERE KEY==150", (vector<string>{}));
+            db.wal.sync();
+            db.clear();
+            db.deserialize_DB();
+        }
+    }
+    data_segment_bytes = (size_t)DATA_SEGMENT_MB << 20;
+
+    // only a table with enough garbage is compacted, the garbage is counted again when the table is opened
+    parse_command("CREATE H A:I B:S KEY A");
+    for (int i = 0; i < NUM_OF_OPS_FOR_GC; i++) parse_command("INSERT " + to_string(i) + " \"row" + to_string(i) + "\" TO H");
+    db.wait_for_compactions();
+    if (db.schemas["H"].compactions != 0 || db.schemas["H"].dead_bytes() != 0 || db.schemas["H"].live_rows != NUM_OF_OPS_FOR_GC) {
+        throw std::invalid_argument("FAIL IN TEST: table with only inserts was compacted");
+    }
+    for (int i = 0; i < NUM_OF_OPS_FOR_GC * 9 / 10; i++) parse_command("DELETE " + to_string(i) + " FROM H");
+    {
+        size_t live_bytes = db.schemas["H"].live_bytes;
+        db.checkpoint();
+        db.clear();
+        db.deserialize_DB();
+        if (db.schemas["H"].live_bytes != live_bytes || db.schemas["H"].live_rows != NUM_OF_OPS_FOR_GC / 10 || db.schemas["H"].dead_ratio() < 0.85) {
+            throw std::invalid_argument("FAIL IN TEST: garbage counted again on open differs");
+        }
+    }
+    // the check comes after NUM_OF_OPS_FOR_GC more changes
+    for (int i = NUM_OF_OPS_FOR_GC * 9 / 10; i < NUM_OF_OPS_FOR_GC; i++) parse_command("DELETE " + to_string(i) + " FROM H");
+    for (int i = NUM_OF_OPS_FOR_GC; i < NUM_OF_OPS_FOR_GC * 19 / 10; i++) parse_command("INSERT " + to_string(i) + " \"row" + to_string(i) + "\" TO H");
+    db.wait_for_compactions();
+    {
+        vector<string> stats = db.stats();
+        auto it = find_if(stats.begin(), stats.end(), [](const string& s) { return s.rfind("H: ", 0) == 0; });
+        if (db.schemas["H"].compactions != 1 || db.schemas["H"].dead_bytes() != 0 || it == stats.end()
+            || it->find("rows=900 ") == string::npos || it->find("(0.0% dead)") == string::npos) {
+            throw std::invalid_argument("FAIL IN TEST: table with garbage wasnt compacted");
+        }
+    }
+    RUN_SELECT_TEST("SELECT * FROM H WHERE KEY==1899", (vector<string>{"1899 \"row1899\""}));
+
+    // int keys are in number order, the index of older versions (keys as strings) is converted when it is opened
+    parse_command("CREATE K A:I B:S KEY A");
+    for (const string& key : vector<string>{"10", "9", "-5", "100"}) parse_command("INSERT " + key + " \"k" + key + "\" TO K");
+    RUN_SELECT_TEST("SELECT * FROM K WHERE KEY>=9", (vector<string>{"9 \"k9\"", "10 \"k10\"", "100 \"k100\""}));
+    db.checkpoint();
+    {
+        BPlusTree<vector<string>, streampos> old_index(MIN_DEGREE, "K");
+        for (const auto& [key, offset] : db.schemas["K"].index_tree->getAllValues()) old_index.insert(db.schemas["K"].columns_of(key), offset);
+        old_index.serialize_Tree();
+        db.schemas["K"].index_tree->remove_files();
+        db.clear();
+        db.deserialize_DB();
+        if (old_index.has_files() || !db.schemas["K"].index_tree->has_files()) {
+            throw std::invalid_argument("FAIL IN TEST: old index wasnt replaced");
+        }
+        RUN_SELECT_TEST("SELECT * FROM K", (vector<string>{"-5 \"k-5\"", "9 \"k9\"", "10 \"k10\"", "100 \"k100\""}));
+    }
+    // a table keyed by one int has the int64 index, the encoded string index of the version before is converted too
+    {
+        if (db.schemas["K"].index_tree->file_name() != "K_int_index_BPlusTree" || !filesystem::exists(db.schemas["K"].index_tree->snapshot_path())) {
+            throw std::invalid_argument("FAIL IN TEST: int keyed table without the int64 index");
+        }
+        BPlusTree<string, streampos> string_index(MIN_DEGREE, "K_index");
+        for (const auto& [key, offset] : db.schemas["K"].index_tree->getAllValues()) string_index.insert(key, offset);
+        string_index.serialize_Tree();
+        db.schemas["K"].index_tree->remove_files();
+        db.clear();
+        db.deserialize_DB();
+        if (string_index.has_files() || !db.schemas["K"].index_tree->has_files()) {
+            throw std::invalid_argument("FAIL IN TEST: string index wasnt replaced");
+        }
+        RUN_SELECT_TEST("SELECT * FROM K WHERE KEY<=9", (vector<string>{"-5 \"k-5\"", "9 \"k9\""}));
+    }
+    // an upgraded index gets the fanout of the table, not the degree the old index was written with
+    parse_command("CREATE KD A:I B:S KEY A");
+    for (int i = 0; i < 300; i++) parse_command("INSERT " + to_string(i) + " \"d\" TO KD");
+    db.checkpoint();
+    {
+        BPlusTree<vector<string>, streampos> old_index(MIN_DEGREE, "KD");
+        for (const auto& [key, offset] : db.schemas["KD"].index_tree->getAllValues()) old_index.insert(db.schemas["KD"].columns_of(key), offset);
+        old_index.serialize_Tree();
+        size_t old_height = old_index.height();
+        db.schemas["KD"].index_tree->remove_files();
+        db.clear();
+        db.deserialize_DB();
+        if (old_height <= 2 || db.schemas["KD"].index_tree->height() != 2 || db.select_records({"SELECT", "*", "FROM", "KD"}).size() != 300) {
+            throw std::invalid_argument("FAIL IN TEST: upgraded index doesnt have the table fanout");
+        }
+    }
+
+    // the fanout of the index is set per table, tiny nodes split and merge all the time and every row is still found
+    parse_command("CREATE F A:I B:S KEY A WITH (fanout=4)");
+    parse_command("CREATE N A:S B:I KEY A WITH ( fanout=256 )");
+    for (int i = 0; i < 500; i++) {
+        int key = i * 7 % 500;
+        parse_command("INSERT " + to_string(key) + " \"f" + to_string(key) + "\" TO F");
+        parse_command("INSERT \"w" + to_string(1000 + key) + "\" " + to_string(key) + " TO N");
+    }
+    for (int i = 0; i < 500; i += 3) parse_command("DELETE " + to_string(i) + " FROM F");
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY>=496", (vector<string>{"496 \"f496\"", "497 \"f497\"", "499 \"f499\""}));
+    db.checkpoint();
+    db.clear();
+    db.deserialize_DB();
+    if (db.schemas["F"].fanout != 4 || db.schemas["N"].fanout != 256 || db.schemas["F"].index_tree->height() <= db.schemas["N"].index_tree->height()
+        || db.select_records({"SELECT", "*", "FROM", "F"}).size() != 333 || db.select_records({"SELECT", "*", "FROM", "N"}).size() != 500) {
+        throw std::invalid_argument("FAIL IN TEST: tables with their own fanout");
+    }
+    RUN_SELECT_TEST("SELECT * FROM N WHERE KEY==\"w1499\"", (vector<string>{"\"w1499\" 499"}));
+    RUN_SELECT_TEST("SELECT * FROM N WHERE B>=498", (vector<string>{"\"w1498\" 498", "\"w1499\" 499"}));
+    // INSERT and DELETE on a table of one int key column use the int key of its int64 tree
+    if (!db.schemas["F"].int_index || db.schemas["N"].int_index) throw std::invalid_argument("FAIL IN TEST: int64 index of a table");
+    parse_command("INSERT -5 \"neg\" TO F");
+    RUN_FAILURE_TEST("INSERT -5 \"dup\" TO F", "Duplicate primary key.");
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY<1", (vector<string>{"-5 \"neg\""}));
+    parse_command("DELETE -5 FROM F");
+    RUN_FAILURE_TEST("DELETE -5 FROM F", "Record with given primary key does not exist.");
+    for (const string& bad : vector<string>{"CREATE X A:I KEY A WITH (fanout=5)", "CREATE X A:I KEY A WITH (fanout=2)", "CREATE X A:I KEY A WITH (fanout=4096)",
+                                            "CREATE X A:I KEY A WITH (depth=4)", "CREATE X A:I KEY A WITH fanout=8"}) {
+        try {
+            parse_command(bad);
+            throw std::invalid_argument("FAIL IN TEST: " + bad + " Got: Success Wanted: an error");
+        } catch (const std::invalid_argument& e) {
+            if (string(e.what()).find("FAIL IN TEST") == 0 || db.schemas.count("X")) throw;
+        }
+    }
+    std::cout << "Success in TEST index fanout per table" << std::endl;
+
+    // scans pull rows one at a time through a cursor over the leaves and can stop at any row
+    {
+        BPlusTree<int64_t, int64_t> tree(2, "cursor");
+        if (tree.first().valid() || tree.seek(1).valid()) throw std::invalid_argument("FAIL IN TEST: cursor of an empty tree");
+        for (int64_t i = 0; i < 300; i += 3) tree.insert(i, i * 2);
+        auto cursor = tree.seek(100);
+        for (int64_t want = 102; want < 300; want += 3, cursor.next()) {
+            if (!cursor.valid() || cursor.key() != want || cursor.value() != want * 2 || cursor.compare(want) != 0) {
+                throw std::invalid_argument("FAIL IN TEST: cursor at " + to_string(want));
+            }
+        }
+        if (cursor.valid() || tree.seek(298).valid()) throw std::invalid_argument("FAIL IN TEST: cursor past the last key");
+        Schema& schema = db.schemas["F"];
+        auto rows = schema.rows(schema.key_of({"100"}), schema.key_of({"105"}));
+        vector<string> got;
+        for (vector<string> row; rows.next(row);) got.push_back(row[0] + " " + row[1]);
+        if (got != vector<string>{"100 f100", "101 f101", "103 f103", "104 f104"}) {
+            throw std::invalid_argument("FAIL IN TEST: row iterator over a key range");
+        }
+        size_t emitted = 0;
+        db.select_rows({"SELECT", "*", "FROM", "F"}, [&](const string&) { return ++emitted < 5; });
+        if (emitted != 5) throw std::invalid_argument("FAIL IN TEST: select didnt stop when asked");
+    }
+    std::cout << "Success in TEST cursor and row iterator" << std::endl;
+    RUN_SELECT_TEST("SELECT B A FROM F WHERE KEY>=496", (vector<string>{"\"f496\" 496", "\"f497\" 497", "\"f499\" 499"}));
+
+    // all the KEY clauses are merged into one interval (and the != keys) before the index is walked
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY>=100 KEY<=110 KEY!=104 KEY>=101 KEY<=107 KEY!=200",
+                    (vector<string>{"101 \"f101\"", "103 \"f103\"", "106 \"f106\"", "107 \"f107\""}));
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY<=107 KEY==106 KEY>=100", (vector<string>{"106 \"f106\""}));
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY>=110 KEY<=100", (vector<string>{}));
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY==101 KEY==103", (vector<string>{}));
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY!=0 KEY!=1 KEY<=5", (vector<string>{"2 \"f2\"", "4 \"f4\"", "5 \"f5\""}));
+
+    // WHERE is parsed once into an expression (AND OR NOT, parentheses, < >) and int columns compare as numbers
+    parse_command("CREATE E A:I B:S C:I KEY A");
+    for (int i = 1; i <= 12; i++) parse_command("INSERT " + to_string(i) + " \"e" + to_string(i % 3) + "\" " + to_string(i * 5) + " TO E");
+    RUN_SELECT_TEST("SELECT A FROM E WHERE C>=10 C<20", (vector<string>{"2", "3"}));
+    RUN_SELECT_TEST("SELECT A FROM E WHERE C>45", (vector<string>{"10", "11", "12"}));
+    RUN_SELECT_TEST("SELECT A FROM E WHERE B==\"e0\" AND NOT C>40", (vector<string>{"3", "6"}));
+    RUN_SELECT_TEST("SELECT A FROM E WHERE KEY<3 OR (B==\"e1\" AND KEY>=7)", (vector<string>{"1", "2", "7", "10"}));
+    RUN_SELECT_TEST("SELECT A B FROM E WHERE KEY>9 NOT (B!=\"e2\" OR C==60)", (vector<string>{"11 \"e2\""}));
+    RUN_SELECT_TEST("SELECT * FROM F WHERE KEY>=496 B!=\"f497\"", (vector<string>{"496 \"f496\"", "499 \"f499\""}));
+    RUN_FAILURE_TEST("SELECT * FROM E WHERE (C>5", "missing ) in WHERE clause");
+    RUN_FAILURE_TEST("SELECT * FROM E WHERE C>5 OR", "WHERE clause ends in the middle of an expression");
+    RUN_FAILURE_TEST("SELECT * FROM E WHERE D>5", "the column D doesnt exist");
+    RUN_FAILURE_TEST("SELECT * FROM E WHERE C>\"x\"", "value given doesnt match column C type");
+    RUN_FAILURE_TEST("SELECT * FROM E WHERE C=5", "UNKONWN COMPARSION OPERATOR (SHOULD ONLY BE >= <= > < != ==)");
+
+    // the filter kernels over an int column give the rows a row by row compare gives, with and without a selection
+    {
+        vector<int64_t> column(1003);
+        for (size_t i = 0; i < column.size(); i++) column[i] = (int64_t)(i * 7919 % 61) - 30;
+        vector<uint32_t> odd, got(column.size());
+        for (uint32_t i = 1; i < column.size(); i += 2) odd.push_back(i);
+        // every kernel up to the best the cpu has
+        for (SimdLevel level : {SimdLevel::SCALAR, SimdLevel::SSE42, SimdLevel::AVX2}) {
+            if (level > cpu_simd_level()) break;
+            simd_level = level;
+            for (CmpOp op : {CmpOp::LT, CmpOp::LE, CmpOp::EQ, CmpOp::NE, CmpOp::GE, CmpOp::GT}) {
+                for (int64_t literal : vector<int64_t>{-31, -30, 0, 7, 30, INT64_MIN}) {
+                    vector<uint32_t> dense, sparse;
+                    for (uint32_t i = 0; i < column.size(); i++) {
+                        int64_t v = column[i];
+                        if (!cmp_passes(op, v < literal ? -1 : v > literal)) continue;
+                        dense.push_back(i);
+                        if (i % 2) sparse.push_back(i);
+                    }
+                    size_t n = select_int_column(op, column.data(), literal, nullptr, column.size(), got.data());
+                    if (vector<uint32_t>(got.begin(), got.begin() + n) != dense) throw std::invalid_argument("FAIL IN TEST: dense int kernel");
+                    n = select_int_column(op, column.data(), literal, odd.data(), odd.size(), got.data());
+                    if (vector<uint32_t>(got.begin(), got.begin() + n) != sparse) throw std::invalid_argument("FAIL IN TEST: int kernel over a selection");
+                }
+            }
+            // the in-node search of an int64 tree
+            vector<int64_t> keys;
+            for (int64_t k = -20; k <= 20; k += 2) keys.push_back(k);
+            for (size_t n = 0; n <= keys.size(); n++) {
+                vector<int64_t> prefix(keys.begin(), keys.begin() + n);
+                for (int64_t key = -22; key <= 22; key++) {
+                    if (node_bound<false>(prefix, key) != size_t(lower_bound(prefix.begin(), prefix.end(), key) - prefix.begin()) ||
+                        node_bound<true>(prefix, key) != size_t(upper_bound(prefix.begin(), prefix.end(), key) - prefix.begin())) {
+                        throw std::invalid_argument("FAIL IN TEST: " + string(simd_name(level)) + " node search");
+                    }
+                }
+            }
+            std::cout << "Success in TEST " << simd_name(level) << " int filter kernel" << std::endl;
+        }
+        simd_level = cpu_simd_level();
+    }
+    // a scan of more than one batch filters each batch by column and gives the rows the row filter gives
+    parse_command("CREATE V A:I B:I C:S KEY A");
+    for (int i = 0; i < 2500; i++) parse_command("INSERT " + to_string(i) + " " + to_string(i % 97 - 40) + " \"v" + to_string(i % 5) + "\" TO V");
+    {
+        vector<string> select = {"SELECT", "*", "FROM", "V", "WHERE", "B>-10", "(C==\"v1\"", "OR", "NOT", "B<=40)", "KEY!=1501"};
+        KeyRange range;
+        RowFilter filter = db.schemas["V"].compile_where(select, range);
+        size_t wanted = 0;
+        auto rows = db.schemas["V"].rows(range);
+        for (vector<string> row; rows.next(row);) wanted += filter.passes(row);
+        if (db.select_records(select).size() != wanted || wanted == 0) throw std::invalid_argument("FAIL IN TEST: batch scan and row filter");
+    }
+    RUN_SELECT_TEST("SELECT A FROM V WHERE B>=55 C==\"v3\" KEY<=1000", (vector<string>{"193", "483", "678", "968"}));
+    std::cout << "Success in TEST column batch filters" << std::endl;
+
+    // a range cut into parts scanned by several threads gives the rows of one thread, in key order or all of them unordered
+    {
+        vector<string> select = {"SELECT", "*", "FROM", "V", "WHERE", "C!=\"v2\"", "KEY>=10", "KEY<2400"};
+        scan_threads = 1;
+        vector<string> serial = db.select_records(select);
+        scan_threads = 4;
+        scan_morsel_rows = 64 * 3; // parts of 3 leaves
+        for (bool mapped : {true, false}) {
+            mmap_reads = mapped;
+            if (db.select_records(select) != serial) throw std::invalid_argument("FAIL IN TEST: parallel scan in key order");
+        }
+        mmap_reads = true;
+        Schema& schema = db.schemas["V"];
+        if (schema.index_tree->split_keys(schema.key_of({"10"}), schema.key_of({"2399"}), 3).size() < 4) {
+            throw std::invalid_argument("FAIL IN TEST: the range wasnt cut into parts");
+        }
+        vector<string> unordered;
+        schema.scan(select, [&](const vector<string>& row) {
+            unordered.push_back(row[0] + " \"" + row[2] + "\"");
+            return true;
+        }, false);
+        vector<string> keys_and_c;
+        for (const string& row : serial) keys_and_c.push_back(row.substr(0, row.find(' ')) + row.substr(row.rfind(' ')));
+        sort(unordered.begin(), unordered.end());
+        sort(keys_and_c.begin(), keys_and_c.end());
+        if (unordered != keys_and_c) throw std::invalid_argument("FAIL IN TEST: unordered parallel scan");
+        size_t emitted = 0;
+        db.select_rows(select, [&](const string& line) { return line == serial[emitted++] && emitted < 700; });
+        if (emitted != 700) throw std::invalid_argument("FAIL IN TEST: parallel scan didnt stop when asked");
+        scan_morsel_rows = SCAN_MORSEL_ROWS;
+    }
+    std::cout << "Success in TEST parallel scan" << std::endl;
+
+    // the task pool: tasks wait for the tasks they submit, an exception reaches the waiter, sorting in chunks
+    {
+        TaskPool pool(3);
+        std::function<long long(int)> sum = [&](int n) -> long long {
+            if (n <= 1) return n;
+            auto left = pool.submit([&, n] { return sum(n - 1); });
+            long long right = n;
+            pool.wait(left);
+            return left.get() + right;
+        };
+        auto total = pool.submit([&] { return sum(200); });
+        pool.wait(total);
+        if (total.get() != 200 * 201 / 2) throw std::invalid_argument("FAIL IN TEST: nested tasks of the pool");
+        atomic<size_t> ran = 0;
+        try {
+            pool.parallel_for(50, [&](size_t i) {
+                ran++;
+                if (i == 17) throw std::runtime_error("task 17");
+            });
+            throw std::invalid_argument("FAIL IN TEST: parallel_for didnt throw");
+        } catch (const std::runtime_error& e) {
+            if (string(e.what()) != "task 17" || ran != 50) throw std::invalid_argument("FAIL IN TEST: exception of a task");
+        }
+        vector<int> values(100000);
+        for (size_t i = 0; i < values.size(); i++) values[i] = (int)(i * 7919 % 100003);
+        vector<int> sorted = values;
+        sort(sorted.begin(), sorted.end());
+        parallel_sort(values.begin(), values.end(), less<int>(), 1000);
+        if (values != sorted) throw std::invalid_argument("FAIL IN TEST: parallel_sort");
+    }
+    // restoring loads the indexes and counts the rows of all the tables on the pool
+    {
+        vector<string> tables;
+        for (int t = 0; t < 20; t++) {
+            string name = "R" + to_string(t);
+            tables.push_back(name);
+            parse_command("CREATE " + name + " A:I B:S KEY A");
+            for (int i = 0; i < 50 + t; i++) parse_command("INSERT " + to_string(i) + " \"r" + to_string(t) + "\" TO " + name);
+        }
+        db.checkpoint();
+        vector<string> before = db.stats();
+        db.clear();
+        db.deserialize_DB();
+        if (db.stats() != before) throw std::invalid_argument("FAIL IN TEST: tables restored on the pool");
+        for (int t = 0; t < 20; t++) {
+            if (db.select_records({"SELECT", "*", "FROM", tables[t]}).size() != (size_t)(50 + t)) throw std::invalid_argument("FAIL IN TEST: rows of " + tables[t]);
+        }
+    }
+    std::cout << "Success in TEST task pool" << std::endl;
+
     filesystem::remove_all("DB_files");
     return 0;
 }
\ No newline at end of file